@@ -6,14 +6,20 @@ echo "Building core library..."
 
 as corelib/syscall_x86.asm -o build/syscall_x86.o
 cc corelib/sys.c -o build/sys.o $CFLAGS
+cc corelib/malloc.c -o build/malloc.o $CFLAGS
 cc corelib/io.c -o build/io.o $CFLAGS
+cc corelib/mem.c -o build/mem.o $CFLAGS
 cc corelib/str.c -o build/str.o $CFLAGS
+cc corelib/dtoa.c -o build/dtoa.o $CFLAGS
 
 ar rcs build/liborka_corelib.a \
     build/syscall_x86.o \
     build/sys.o \
+    build/malloc.o \
     build/io.o \
-    build/str.o
+    build/mem.o \
+    build/str.o \
+    build/dtoa.o
 
 as corelib/x64_start.asm -o build/occ_start.o
 
@@ -27,28 +27,53 @@ Compiler::Compiler(AstTree *tree, CFlags cflags) {
     builder = std::make_unique<IRBuilder<>>(*context);
     
     // Create the global structure type
+    // The length is 64 bits wide, so arrays can be larger than 2 GiB
     std::vector<Type *> arrayTypes;
     arrayTypes.push_back(Type::getInt32PtrTy(*context));
-    arrayTypes.push_back(Type::getInt32Ty(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
     i32ArrayType = StructType::create(*context, arrayTypes);
     i32ArrayType->setName("IntArrayType");
     
     arrayTypes.clear();
     arrayTypes.push_back(Type::getInt64PtrTy(*context));
-    arrayTypes.push_back(Type::getInt32Ty(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
     i64ArrayType = StructType::create(*context, arrayTypes);
     i64ArrayType->setName("Int64ArrayType");
     
     arrayTypes.clear();
     arrayTypes.push_back(Type::getInt8PtrTy(*context));
-    arrayTypes.push_back(Type::getInt32Ty(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
     i8ArrayType = StructType::create(*context, arrayTypes);
     i8ArrayType->setName("CharArrayType");
     
+    arrayTypes.clear();
+    arrayTypes.push_back(PointerType::getUnqual(Type::getInt1Ty(*context)));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
+    i1ArrayType = StructType::create(*context, arrayTypes);
+    i1ArrayType->setName("BoolArrayType");
+    
+    arrayTypes.clear();
+    arrayTypes.push_back(Type::getInt16PtrTy(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
+    i16ArrayType = StructType::create(*context, arrayTypes);
+    i16ArrayType->setName("ShortArrayType");
+    
+    arrayTypes.clear();
+    arrayTypes.push_back(Type::getFloatPtrTy(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
+    floatArrayType = StructType::create(*context, arrayTypes);
+    floatArrayType->setName("FloatArrayType");
+    
+    arrayTypes.clear();
+    arrayTypes.push_back(Type::getDoublePtrTy(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
+    doubleArrayType = StructType::create(*context, arrayTypes);
+    doubleArrayType->setName("DoubleArrayType");
+    
     auto strList = PointerType::getUnqual(Type::getInt8PtrTy(*context));
     arrayTypes.clear();
     arrayTypes.push_back(strList);
-    arrayTypes.push_back(Type::getInt32Ty(*context));
+    arrayTypes.push_back(Type::getInt64Ty(*context));
     strArrayType = StructType::create(*context, arrayTypes);
     strArrayType->setName("StrArrayType");
 
@@ -57,16 +82,55 @@ Compiler::Compiler(AstTree *tree, CFlags cflags) {
     //
     
     // Malloc
-    FunctionType *FT1 = FunctionType::get(Type::getInt8PtrTy(*context), Type::getInt32Ty(*context), false);
+    FunctionType *FT1 = FunctionType::get(Type::getInt8PtrTy(*context), Type::getInt64Ty(*context), false);
     Function::Create(FT1, Function::ExternalLinkage, "malloc", mod.get());
     
+    // Calloc (count, size), for buffers that have to start out zeroed
+    FunctionType *FT1d = FunctionType::get(Type::getInt8PtrTy(*context), { Type::getInt64Ty(*context), Type::getInt64Ty(*context) }, false);
+    Function::Create(FT1d, Function::ExternalLinkage, "calloc", mod.get());
+    
+    // Free and realloc
+    FunctionType *FT1a = FunctionType::get(Type::getVoidTy(*context), Type::getInt8PtrTy(*context), false);
+    Function::Create(FT1a, Function::ExternalLinkage, "free", mod.get());
+    
+    std::vector<Type *> reallocArgs;
+    reallocArgs.push_back(Type::getInt8PtrTy(*context));
+    reallocArgs.push_back(Type::getInt64Ty(*context));
+    FunctionType *FT1b = FunctionType::get(Type::getInt8PtrTy(*context), reallocArgs, false);
+    Function::Create(FT1b, Function::ExternalLinkage, "realloc", mod.get());
+    
+    // Arenas
+    FunctionType *FT1c = FunctionType::get(Type::getInt8PtrTy(*context), false);
+    Function::Create(FT1c, Function::ExternalLinkage, "arena_begin", mod.get());
+    Function::Create(FT1a, Function::ExternalLinkage, "arena_end", mod.get());
+    Function::Create(FT1a, Function::ExternalLinkage, "str_release", mod.get());
+    
     // Println
     FunctionType *FT2 = FunctionType::get(Type::getVoidTy(*context), Type::getInt8PtrTy(*context), false);
     Function::Create(FT2, Function::ExternalLinkage, "println", mod.get());
     
+    // The pieces printf and println are broken into
+    FunctionType *FT2a = FunctionType::get(Type::getVoidTy(*context), { Type::getInt8PtrTy(*context), Type::getInt64Ty(*context) }, false);
+    Function::Create(FT2a, Function::ExternalLinkage, "write_bytes", mod.get());
+    
+    FunctionType *FT2b = FunctionType::get(Type::getVoidTy(*context), Type::getInt8Ty(*context), false);
+    Function::Create(FT2b, Function::ExternalLinkage, "format_char", mod.get());
+    
+    FunctionType *FT2c = FunctionType::get(Type::getVoidTy(*context), Type::getInt64Ty(*context), false);
+    Function::Create(FT2c, Function::ExternalLinkage, "format_int", mod.get());
+    Function::Create(FT2c, Function::ExternalLinkage, "format_hex", mod.get());
+    
+    FunctionType *FT2e = FunctionType::get(Type::getVoidTy(*context), Type::getDoubleTy(*context), false);
+    Function::Create(FT2e, Function::ExternalLinkage, "format_double", mod.get());
+    
+    // flush
+    FunctionType *FT2d = FunctionType::get(Type::getVoidTy(*context), false);
+    Function::Create(FT2d, Function::ExternalLinkage, "flush", mod.get());
+    
     // strlen
     FunctionType *FT3 = FunctionType::get(Type::getInt32Ty(*context), Type::getInt8PtrTy(*context), false);
     Function::Create(FT3, Function::ExternalLinkage, "strlen", mod.get());
+    Function::Create(FT3, Function::ExternalLinkage, "in_arena", mod.get());
     
     // strcmp
     std::vector<Type *> targs;
@@ -76,17 +140,62 @@ Compiler::Compiler(AstTree *tree, CFlags cflags) {
     FunctionType *FT4 = FunctionType::get(Type::getInt32Ty(*context), targs, false);
     Function::Create(FT4, Function::ExternalLinkage, "stringcmp", mod.get());
     
-    // strcat_str(str, str)
+    // mem_equal(ptr, ptr, len)
+    targs.push_back(Type::getInt64Ty(*context));
+    FunctionType *FT4b = FunctionType::get(Type::getInt32Ty(*context), targs, false);
+    Function::Create(FT4b, Function::ExternalLinkage, "mem_equal", mod.get());
+    targs.pop_back();
+    
+    // strcat_str(str, str, buffer)
+    targs.push_back(Type::getInt8PtrTy(*context));
     FunctionType *FT5 = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
     Function::Create(FT5, Function::ExternalLinkage, "strcat_str", mod.get());
     
-    // strcat_char(str, char)
+    // strcat_char(str, char, buffer)
     targs.clear();
     targs.push_back(Type::getInt8PtrTy(*context));
     targs.push_back(Type::getInt8Ty(*context));
+    targs.push_back(Type::getInt8PtrTy(*context));
     
     FunctionType *FT6 = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
     Function::Create(FT6, Function::ExternalLinkage, "strcat_char", mod.get());
+    
+    // strappend_char(str, char, owned)
+    targs.pop_back();
+    targs.push_back(Type::getInt32Ty(*context));
+    FunctionType *FT6a = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
+    Function::Create(FT6a, Function::ExternalLinkage, "strappend_char", mod.get());
+    
+    // strappend_str(str, str, owned) and str_store(buffer, str, owned)
+    targs.clear();
+    targs.push_back(Type::getInt8PtrTy(*context));
+    targs.push_back(Type::getInt8PtrTy(*context));
+    targs.push_back(Type::getInt32Ty(*context));
+    
+    FunctionType *FT6b = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
+    Function::Create(FT6b, Function::ExternalLinkage, "strappend_str", mod.get());
+    Function::Create(FT6b, Function::ExternalLinkage, "str_store", mod.get());
+    
+    // strhash(str, seed)
+    targs.clear();
+    targs.push_back(Type::getInt8PtrTy(*context));
+    targs.push_back(Type::getInt32Ty(*context));
+    
+    FunctionType *FT7 = FunctionType::get(Type::getInt32Ty(*context), targs, false);
+    Function::Create(FT7, Function::ExternalLinkage, "strhash", mod.get());
+    
+    // str_take(str, owned) and str_unique(str, owned)
+    FunctionType *FT7a = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
+    Function::Create(FT7a, Function::ExternalLinkage, "str_take", mod.get());
+    Function::Create(FT7a, Function::ExternalLinkage, "str_unique", mod.get());
+    
+    // str_new(len, buffer)
+    targs.clear();
+    targs.push_back(Type::getInt64Ty(*context));
+    targs.push_back(Type::getInt8PtrTy(*context));
+    
+    FunctionType *FT7b = FunctionType::get(Type::getInt8PtrTy(*context), targs, false);
+    Function::Create(FT7b, Function::ExternalLinkage, "str_new", mod.get());
 }
 
 void Compiler::compile() {
@@ -105,6 +214,13 @@ void Compiler::compile() {
         structTable[str->getName()] = s;
     }
 
+    // Globals come first, so every function can see them
+    for (auto global : tree->getGlobalStatements()) {
+        if (global->getType() == AstType::GlobalVar) {
+            compileGlobalVariable(static_cast<AstGlobalVar *>(global));
+        }
+    }
+
     // Build all other functions
     for (auto global : tree->getGlobalStatements()) {
         switch (global->getType()) {
@@ -125,10 +241,123 @@ void Compiler::compile() {
     }
 }
 
+// Builds a global variable
+// Nothing runs at startup: constant arrays are emitted with their elements, and
+// are read-only; everything else starts at its init value or at zero. An array is
+// a descriptor pointing to a separate global holding the elements.
+void Compiler::compileGlobalVariable(AstGlobalVar *gv) {
+    Type *type = translateType(gv->getDataType(), gv->getPtrType());
+    Constant *init = Constant::getNullValue(type);
+    
+    if (gv->getDataType() == DataType::Array) {
+        StructType *arrayType = static_cast<StructType *>(type);
+        Type *elementType = arrayType->getElementType(0)->getPointerElementType();
+        std::vector<Constant *> elements;
+        uint64_t size = 0;
+        
+        if (gv->isEmbedded()) {
+            size = gv->getData().length();
+        } else if (gv->isConstant()) {
+            for (auto element : gv->getElements()) {
+                elements.push_back(compileGlobalValue(gv, element, gv->getPtrType(), elementType));
+            }
+            size = elements.size();
+        } else {
+            Constant *sizeVal = compileGlobalValue(gv, gv->getPtrSize(), DataType::Int64, Type::getInt64Ty(*context));
+            size = cast<ConstantInt>(sizeVal)->getZExtValue();
+        }
+        
+        ArrayType *bufferType = ArrayType::get(elementType, size);
+        Constant *bufferInit = ConstantAggregateZero::get(bufferType);
+        if (gv->isEmbedded()) bufferInit = ConstantDataArray::getString(*context, gv->getData(), false);
+        else if (gv->isConstant()) bufferInit = ConstantArray::get(bufferType, elements);
+        
+        GlobalVariable *buffer = new GlobalVariable(*mod, bufferType, gv->isConstant(), GlobalValue::InternalLinkage,
+                                                    bufferInit, gv->getName() + ".elements");
+        
+        Constant *indices[] = { builder->getInt32(0), builder->getInt32(0) };
+        Constant *first = ConstantExpr::getInBoundsGetElementPtr(bufferType, buffer, indices);
+        init = ConstantStruct::get(arrayType, { first, builder->getInt64(size) });
+    } else if (gv->getExpression()) {
+        init = compileGlobalValue(gv, gv->getExpression(), gv->getDataType(), type);
+    }
+    
+    GlobalVariable *var = new GlobalVariable(*mod, type, gv->isConstant(), GlobalValue::InternalLinkage, init, gv->getName());
+    globalTable[gv->getName()] = var;
+    globals.push_back(gv);
+}
+
+// Compiles the init value of a global
+// It has to fold to a constant, since there is no code to compute it
+Constant *Compiler::compileGlobalValue(AstGlobalVar *gv, AstExpression *expr, DataType dataType, Type *type) {
+    Constant *val = nullptr;
+    if (isConstantExpression(expr)) {
+        Value *result = castValue(compileValue(expr, dataType), type, isUnsignedExpression(expr), isUnsignedType(dataType));
+        val = dyn_cast<Constant>(result);
+    }
+    
+    if (!val) {
+        addError("The value of global \"" + gv->getName() + "\" must be constant.");
+        return Constant::getNullValue(type);
+    }
+    return val;
+}
+
+// Checks if an expression is built only from literals
+bool Compiler::isConstantExpression(AstExpression *expr) {
+    switch (expr->getType()) {
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL:
+        case AstType::FloatL:
+        case AstType::StringL: return true;
+        
+        case AstType::Neg:
+        case AstType::Not:
+        case AstType::BitNot: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            return isConstantExpression(op->getVal());
+        }
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Mod:
+        case AstType::BitAnd:
+        case AstType::BitOr:
+        case AstType::BitXor:
+        case AstType::Lsh:
+        case AstType::Rsh: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return isConstantExpression(op->getLVal()) && isConstantExpression(op->getRVal());
+        }
+        
+        default: {}
+    }
+    
+    return false;
+}
+
 void Compiler::debug() {
     mod->print(errs(), nullptr);
 }
 
+// Returns true if any semantic error was found while compiling
+bool Compiler::hasErrors() {
+    return errorCount > 0;
+}
+
+// Reports a semantic error
+// Compiling goes on so every error gets reported, but nothing is written out
+void Compiler::addError(std::string message) {
+    std::cerr << "Error: " << message << std::endl;
+    ++errorCount;
+}
+
 void Compiler::emitLLVM(std::string path) {
     std::error_code errorCode;
     raw_fd_ostream writer(path, errorCode, sys::fs::OF_None);
@@ -144,14 +373,75 @@ void Compiler::compileStatement(AstStatement *stmt) {
             AstVarDec *vd = static_cast<AstVarDec *>(stmt);
             Type *type = translateType(vd->getDataType(), vd->getPtrType());
             
-            AllocaInst *var = builder->CreateAlloca(type);
+            AllocaInst *var = createEntryAlloca(type);
             symtable[vd->getName()] = var;
             typeTable[vd->getName()] = vd->getDataType();
             ptrTable[vd->getName()] = vd->getPtrType();
             
-            // If we have an array, set the size of the structure
+            if (vd->getDataType() == DataType::String) {
+                ownerFlags[var] = createOwnerFlag();
+                inlineSlots[var] = createStringBuffer();
+                if (!arenaStack.empty()) arenaVars.push_back(var);
+            }
+            
+            // If we have an array, allocate the elements and set the size of the structure
+            // The element size comes from the data layout, so it is right for every element type
             if (vd->getDataType() == DataType::Array) {
                 Value *size = compileValue(vd->getPtrSize());
+                size = castInt(size, Type::getInt64Ty(*context), isUnsignedExpression(vd->getPtrSize()));
+                
+                Type *bufferType = static_cast<StructType *>(type)->getElementType(0);
+                Type *elementType = bufferType->getPointerElementType();
+                Value *buffer;
+                
+                // Small constant-size arrays that never leave the function go on the stack.
+                // The alloca goes in the entry block so a declaration in a loop doesn't grow the stack,
+                // but it is cleared where the declaration runs, so arrays still start out zeroed.
+                ConstantInt *constSize = dyn_cast<ConstantInt>(size);
+                uint64_t elementSize = mod->getDataLayout().getTypeAllocSize(elementType);
+                
+                if (constSize && escapeSet.find(vd->getName()) == escapeSet.end()
+                    && constSize->getZExtValue() * elementSize <= MAX_STACK_ARRAY) {
+                    BasicBlock *entry = &currentFunc->getEntryBlock();
+                    IRBuilder<> entryBuilder(entry, entry->begin());
+                    buffer = entryBuilder.CreateAlloca(elementType, constSize);
+                    builder->CreateMemSet(buffer, builder->getInt8(0), constSize->getZExtValue() * elementSize,
+                                          MaybeAlign(mod->getDataLayout().getPrefTypeAlignment(elementType)));
+                } else {
+                    // Arrays that never move are freed on return. The buffer starts out null,
+                    // and a declaration that runs again (in a loop) frees the last one first.
+                    // Arrays in an arena go away with the arena instead.
+                    //
+                    // An array that is assigned over, but never given away, owns its buffer
+                    // until the assignment. A flag says whether it still does.
+                    bool owned = moveSet.find(vd->getName()) == moveSet.end();
+                    bool flagged = !owned && givenSet.find(vd->getName()) == givenSet.end();
+                    if ((owned || flagged) && arenaStack.empty()) {
+                        BasicBlock *entry = &currentFunc->getEntryBlock();
+                        IRBuilder<> entryBuilder(entry, std::next(var->getIterator()));
+                        Value *entryPtr = entryBuilder.CreateStructGEP(var, 0);
+                        entryBuilder.CreateStore(ConstantPointerNull::get(cast<PointerType>(bufferType)), entryPtr);
+                        
+                        Value *oldPtr = builder->CreateStructGEP(var, 0);
+                        if (owned) {
+                            ownedArrays.push_back(var);
+                            freeIfOwned(builder->CreateLoad(oldPtr), builder->getInt1(true));
+                        } else {
+                            if (arrayFlags.find(var) == arrayFlags.end()) arrayFlags[var] = createOwnerFlag();
+                            freeIfOwned(builder->CreateLoad(oldPtr), builder->CreateLoad(arrayFlags[var]));
+                            builder->CreateStore(builder->getInt1(true), arrayFlags[var]);
+                        }
+                    }
+                    
+                    // The buffer may come off a free list, so it has to be cleared
+                    Function *callocFunc = mod->getFunction("calloc");
+                    buffer = builder->CreateCall(callocFunc, { size, ConstantExpr::getSizeOf(elementType) });
+                    buffer = builder->CreateBitCast(buffer, bufferType);
+                }
+                
+                Value *bufferPtr = builder->CreateStructGEP(var, 0);
+                builder->CreateStore(buffer, bufferPtr);
+                
                 Value *sizePtr = builder->CreateStructGEP(var, 1);
                 builder->CreateStore(size, sizePtr);
             }
@@ -196,12 +486,57 @@ void Compiler::compileStatement(AstStatement *stmt) {
             AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
             AllocaInst *ptr = symtable[va->getName()];
             DataType ptrType = typeTable[va->getName()];
+            
+            // s := s + x appends in place
+            if (ownerFlags.find(ptr) != ownerFlags.end() && isStringAppend(va)) {
+                compileStringAppend(va);
+                break;
+            }
+            
             Value *val = compileValue(stmt->getExpressions().at(0), ptrType);
             
             if (ptrType == DataType::Array) {
-                Value *arrayPtr = builder->CreateStructGEP(ptr, 0);
-                builder->CreateStore(val, arrayPtr);
+                // The variable takes the other array's buffer and size, and frees a buffer
+                // it still owns first (unless it is being assigned to itself)
+                if (arrayFlags.find(ptr) != arrayFlags.end()) {
+                    AllocaInst *flag = arrayFlags[ptr];
+                    Value *old = builder->CreateLoad(builder->CreateStructGEP(ptr, 0));
+                    Value *owned = builder->CreateLoad(flag);
+                    owned = builder->CreateAnd(owned, builder->CreateICmpNE(old, builder->CreateExtractValue(val, 0)));
+                    freeIfOwned(old, owned);
+                    builder->CreateStore(builder->getInt1(false), flag);
+                }
+                builder->CreateStore(val, ptr);
+            } else if (ownerFlags.find(ptr) != ownerFlags.end()) {
+                // The variable takes a reference to the value, and drops the one it had
+                // A temporary hands its reference over. Short strings in another buffer
+                // are copied into the variable's own.
+                AllocaInst *flag = ownerFlags[ptr];
+                Value *owned = builder->getInt32(0);
+                if (tempStrings.find(val) != tempStrings.end()) {
+                    tempStrings.erase(val);
+                    owned = builder->getInt32(1);
+                }
+                
+                Function *storeFunc = mod->getFunction("str_store");
+                val = builder->CreateCall(storeFunc, { inlineSlots[ptr], val, owned });
+                
+                Value *old = builder->CreateLoad(ptr);
+                Value *oldOwned = builder->CreateLoad(flag);
+                releaseString(old, oldOwned);
+                
+                builder->CreateStore(val, ptr);
+                builder->CreateStore(builder->getInt1(canOwn(ptr)), flag);
+            } else if (ptrType == DataType::String && isa<GlobalVariable>((Value *)ptr)) {
+                // A global string always holds a reference to its value
+                val = retainString(stmt->getExpressions().at(0), val, false);
+                
+                Value *old = builder->CreateLoad(ptr);
+                releaseString(old, builder->getInt1(true));
+                builder->CreateStore(val, ptr);
             } else {
+                Type *varType = ptr->getType()->getPointerElementType();
+                val = castValue(val, varType, isUnsignedExpression(stmt->getExpressions().at(0)), isUnsignedType(ptrType));
                 builder->CreateStore(val, ptr);
             }
         } break;
@@ -215,15 +550,33 @@ void Compiler::compileStatement(AstStatement *stmt) {
             
             Value *index = compileValue(pa->getExpressions().at(0));
             Value *val = compileValue(pa->getExpressions().at(1), subType);
+            bool isUnsigned = isUnsignedExpression(pa->getExpressions().at(1));
+            val = retainString(pa->getExpressions().at(1), val, false);
             
             if (ptrType == DataType::String) {
+                // Copy on write: the string has to be ours alone before we change it
+                AllocaInst *var = symtable[pa->getName()];
+                if (ownerFlags.find(var) != ownerFlags.end()) {
+                    compileStringUnique(var);
+                } else if (isa<GlobalVariable>((Value *)var)) {
+                    Function *uniqueFunc = mod->getFunction("str_unique");
+                    Value *str = builder->CreateLoad(var);
+                    builder->CreateStore(builder->CreateCall(uniqueFunc, { str, builder->getInt32(1) }), var);
+                }
+                
                 Value *arrayPtr = builder->CreateLoad(ptr);
                 Value *ep = builder->CreateGEP(arrayPtr, index);
+                val = castValue(val, ep->getType()->getPointerElementType(), isUnsigned, isUnsignedType(subType));
                 builder->CreateStore(val, ep);
             } else {
+                if (checkBounds && !isSafeIndex(pa->getName(), pa->getExpressions().at(0))) {
+                    compileBoundsCheck(index, ptr, isUnsignedExpression(pa->getExpressions().at(0)));
+                }
+                
                 Value *arrayPtr = builder->CreateStructGEP(ptr, 0);
                 Value *ptrLd = builder->CreateLoad(arrayPtr);
                 Value *ep = builder->CreateGEP(ptrLd, index);
+                val = castValue(val, ep->getType()->getPointerElementType(), isUnsigned, isUnsignedType(subType));
                 builder->CreateStore(val, ep);
             }
         } break;
@@ -235,6 +588,7 @@ void Compiler::compileStatement(AstStatement *stmt) {
             int index = getStructIndex(sa->getName(), sa->getMember());
             
             Value *val = compileValue(sa->getExpressions().at(0), sa->getMemberType());
+            val = retainString(sa->getExpressions().at(0), val, false);
             
             Value *structPtr = builder->CreateStructGEP(ptr, index);
             builder->CreateStore(val, structPtr);
@@ -271,13 +625,22 @@ void Compiler::compileStatement(AstStatement *stmt) {
         // A for-all loop
         case AstType::ForAll: compileForAllStatement(stmt); break;
         
+        // A match statement
+        case AstType::Match: compileMatchStatement(stmt); break;
+        
+        // An arena block
+        case AstType::Arena: compileArenaStatement(stmt); break;
+        
         // A break statement
+        // Any arenas opened inside the loop have to end first
         case AstType::Break: {
+            compileArenaExit(breakStack.size());
             builder->CreateBr(breakStack.top());
         } break;
         
         // A continue statement
         case AstType::Continue: {
+            compileArenaExit(continueStack.size());
             builder->CreateBr(continueStack.top());
         } break;
         
@@ -327,7 +690,7 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
         
         case AstType::StringL: {
             AstString *str = static_cast<AstString *>(expr);
-            return builder->CreateGlobalStringPtr(str->getValue());
+            return compileStringLiteral(str->getValue());
         } break;
         
         case AstType::ID: {
@@ -358,6 +721,10 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
                 Value *ep = builder->CreateGEP(arrayPtr, index);
                 return builder->CreateLoad(ep);
             } else {
+                if (checkBounds && !isSafeIndex(acc->getValue(), acc->getIndex())) {
+                    compileBoundsCheck(index, ptr, isUnsignedExpression(acc->getIndex()));
+                }
+                
                 Value *arrayPtr = builder->CreateStructGEP(ptr, 0);
                 Value *ptrLd = builder->CreateLoad(arrayPtr);
                 Value *ep = builder->CreateGEP(ptrLd, index);
@@ -378,14 +745,36 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
             AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
             std::vector<Value *> args;
             
+            Value *builtin = compileBuiltinCall(fc);
+            if (builtin != nullptr) return builtin;
+            
+            Function *callee = mod->getFunction(fc->getName());
+            if (!callee) {
+                // Hand back a zero of the expected type so the caller can keep going
+                std::cerr << "Error: Invalid function call: \"" << fc->getName() << "\"." << std::endl;
+                if (dataType == DataType::Void) dataType = DataType::Int32;
+                return Constant::getNullValue(translateType(dataType));
+            }
+            bool captures = canCapture(callee);
+            
             for (auto stmt : fc->getArguments()) {
-                Value *val = compileValue(stmt);
+                Value *val = compileValue(stmt, argDataType(callee, args.size(), stmt));
+                if (args.size() < callee->arg_size()) {
+                    Type *argType = callee->getArg(args.size())->getType();
+                    val = castInt(val, argType, isUnsignedExpression(stmt));
+                } else if (callee->isVarArg()) {
+                    val = promoteVarArg(val, isUnsignedExpression(stmt));
+                }
+                if (captures) val = retainString(stmt, val, true);
                 args.push_back(val);
             }
             
-            Function *callee = mod->getFunction(fc->getName());
-            if (!callee) std::cerr << "Invalid function call statement." << std::endl;
-            return builder->CreateCall(callee, args);
+            Value *call = builder->CreateCall(callee, args);
+            releaseArguments(args);
+            
+            // The result is a temporary we hold a reference to
+            if (isOrkaStringCall(callee)) tempStrings.insert(call);
+            return call;
         } break;
         
         case AstType::Neg: {
@@ -395,16 +784,41 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
             return builder->CreateNeg(val);
         } break;
         
+        case AstType::Not: {
+            AstNotOp *op = static_cast<AstNotOp *>(expr);
+            Value *val = compileValue(op->getVal());
+            
+            return builder->CreateNot(convertToBool(val));
+        } break;
+        
+        case AstType::And:
+        case AstType::Or: return compileLogicalOp(expr);
+        
+        case AstType::BitNot: {
+            AstBitNotOp *op = static_cast<AstBitNotOp *>(expr);
+            Value *val = compileValue(op->getVal(), dataType);
+            
+            return builder->CreateNot(val);
+        } break;
+        
         case AstType::Add:
         case AstType::Sub: 
         case AstType::Mul:
         case AstType::Div:
+        case AstType::Mod:
+        case AstType::BitAnd:
+        case AstType::BitOr:
+        case AstType::BitXor:
+        case AstType::Lsh:
+        case AstType::Rsh:
         case AstType::EQ:
         case AstType::NEQ:
         case AstType::GT:
         case AstType::LT:
         case AstType::GTE:
         case AstType::LTE: {
+            if (isStringChain(expr)) return compileStringChain(expr);
+            
             AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
             AstExpression *lvalExpr = op->getLVal();
             AstExpression *rvalExpr = op->getRVal();
@@ -412,7 +826,8 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
             Value *lval = compileValue(lvalExpr, dataType);
             Value *rval = compileValue(rvalExpr, dataType);
             
-            bool fltOp = false;
+            // Array elements, calls and the like can produce floats as well
+            bool fltOp = lval->getType()->isFloatingPointTy() || rval->getType()->isFloatingPointTy();
             if (lvalExpr->getType() == AstType::FloatL || rvalExpr->getType() == AstType::FloatL) {
                 fltOp = true;
                 
@@ -440,10 +855,13 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
             bool rvalStr = false;
             
             if (lvalExpr->getType() == AstType::StringL || rvalExpr->getType() == AstType::StringL) {
+                // A literal plus a character is still a character append
                 strOp = true;
-                rvalStr = true;
-            } else if (lvalExpr->getType() == AstType::StringL && rvalExpr->getType() == AstType::CharL) {
-                strOp = true;
+                rvalStr = rvalExpr->getType() != AstType::CharL;
+                if (rvalExpr->getType() == AstType::ID) {
+                    DataType rvalType = typeTable[static_cast<AstID *>(rvalExpr)->getValue()];
+                    rvalStr = rvalType != DataType::Char && rvalType != DataType::Byte;
+                }
             } else if (lvalExpr->getType() == AstType::ID && rvalExpr->getType() == AstType::CharL) {
                 AstID *lvalID = static_cast<AstID *>(lvalExpr);
                 if (typeTable[lvalID->getValue()] == DataType::String) strOp = true;
@@ -467,10 +885,31 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
                 args.push_back(lval);
                 args.push_back(rval);
             
-                if (op->getType() == AstType::EQ || op->getType() == AstType::NEQ) {
+                if ((op->getType() == AstType::EQ || op->getType() == AstType::NEQ) && rvalStr
+                    && lval->getType()->isPointerTy() && rval->getType()->isPointerTy()) {
+                    // Literals are compared inline, or folded if both sides are literals
+                    Value *isEqual;
+                    if (lvalExpr->getType() == AstType::StringL && rvalExpr->getType() == AstType::StringL) {
+                        std::string lstr = static_cast<AstString *>(lvalExpr)->getValue();
+                        isEqual = builder->getInt1(lstr == static_cast<AstString *>(rvalExpr)->getValue());
+                    } else if (rvalExpr->getType() == AstType::StringL) {
+                        isEqual = compileLiteralEquals(lval, static_cast<AstString *>(rvalExpr)->getValue());
+                    } else if (lvalExpr->getType() == AstType::StringL) {
+                        isEqual = compileLiteralEquals(rval, static_cast<AstString *>(lvalExpr)->getValue());
+                    } else {
+                        isEqual = compileStringEquals(lval, rval);
+                    }
+                    freeTemporary(lval);
+                    freeTemporary(rval);
+                    
+                    if (op->getType() == AstType::NEQ) return builder->CreateNot(isEqual);
+                    return isEqual;
+                } else if (op->getType() == AstType::EQ || op->getType() == AstType::NEQ) {
                     Function *strcmp = mod->getFunction("stringcmp");
                     if (!strcmp) std::cerr << "Error: Corelib function \"stringcmp\" not found." << std::endl;
                     Value *strcmpCall = builder->CreateCall(strcmp, args);
+                    freeTemporary(lval);
+                    freeTemporary(rval);
                     
                     int cmpVal = 1;
                     if (op->getType() == AstType::NEQ) cmpVal = 0;
@@ -481,11 +920,24 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
                     if (rvalStr) {
                         Function *callee = mod->getFunction("strcat_str");
                         if (!callee) std::cerr << "Error: corelib function \"strcat_str\" not found." << std::endl;
-                        return builder->CreateCall(callee, args);
+                        Value *buffer = createStringBuffer();
+                        args.push_back(buffer);
+                        
+                        Value *result = builder->CreateCall(callee, args);
+                        freeTemporary(lval);
+                        freeTemporary(rval);
+                        tempStrings.insert(result);
+                        return result;
                     } else {
                         Function *callee = mod->getFunction("strcat_char");
                         if (!callee) std::cerr << "Error: corelib function \"strcat_char\" not found." << std::endl;
-                        return builder->CreateCall(callee, args);
+                        Value *buffer = createStringBuffer();
+                        args.push_back(buffer);
+                        
+                        Value *result = builder->CreateCall(callee, args);
+                        freeTemporary(lval);
+                        tempStrings.insert(result);
+                        return result;
                     }
                 } else {
                     // Invalid
@@ -495,11 +947,26 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
             
             // Otherwise, build a normal comparison
             if ((dataType == DataType::Float || dataType == DataType::Double) || fltOp) {
+                // Both sides have to be the same floating-point type. Double wins, and
+                // float literals are rebuilt rather than extended to keep their precision.
+                Type *fltType = Type::getFloatTy(*context);
+                if (dataType == DataType::Double || lval->getType()->isDoubleTy() || rval->getType()->isDoubleTy())
+                    fltType = Type::getDoubleTy(*context);
+                
+                if (fltType->isDoubleTy()) {
+                    if (lvalExpr->getType() == AstType::FloatL) lval = compileValue(lvalExpr, DataType::Double);
+                    if (rvalExpr->getType() == AstType::FloatL) rval = compileValue(rvalExpr, DataType::Double);
+                }
+                
+                lval = castValue(lval, fltType, isUnsignedExpression(lvalExpr));
+                rval = castValue(rval, fltType, isUnsignedExpression(rvalExpr));
+                
                 switch (expr->getType()) {
                     case AstType::Add: return builder->CreateFAdd(lval, rval);
                     case AstType::Sub: return builder->CreateFSub(lval, rval);
                     case AstType::Mul: return builder->CreateFMul(lval, rval);
                     case AstType::Div: return builder->CreateFDiv(lval, rval);
+                    case AstType::Mod: return builder->CreateFRem(lval, rval);
                     
                     case AstType::EQ: return builder->CreateFCmpOEQ(lval, rval);
                     case AstType::NEQ: return builder->CreateFCmpONE(lval, rval);
@@ -511,18 +978,76 @@ Value *Compiler::compileValue(AstExpression *expr, DataType dataType) {
                     default: {}
                 }
             } else {
+                // Signedness comes from the operands. For arithmetic, an unsigned
+                // destination also makes the operation unsigned.
+                bool lvalUnsigned = isUnsignedExpression(lvalExpr);
+                bool rvalUnsigned = isUnsignedExpression(rvalExpr);
+                bool cmpUnsigned = lvalUnsigned || rvalUnsigned;
+                bool isUnsigned = cmpUnsigned || isUnsignedType(dataType);
+                
+                // Widen the narrower operand if the sizes differ
+                bool intOperands = lval->getType()->isIntegerTy() && rval->getType()->isIntegerTy();
+                if (intOperands && lval->getType() != rval->getType() && expr->getType() != AstType::Lsh
+                    && expr->getType() != AstType::Rsh) {
+                    if (lval->getType()->getIntegerBitWidth() < rval->getType()->getIntegerBitWidth())
+                        lval = castInt(lval, rval->getType(), lvalUnsigned);
+                    else
+                        rval = castInt(rval, lval->getType(), rvalUnsigned);
+                }
+                
                 switch (expr->getType()) {
                     case AstType::Add: return builder->CreateAdd(lval, rval);
                     case AstType::Sub: return builder->CreateSub(lval, rval);
                     case AstType::Mul: return builder->CreateMul(lval, rval);
-                    case AstType::Div: return builder->CreateSDiv(lval, rval);
+                    
+                    case AstType::Div: {
+                        if (isUnsigned) return builder->CreateUDiv(lval, rval);
+                        return builder->CreateSDiv(lval, rval);
+                    }
+                    
+                    case AstType::Mod: {
+                        if (isUnsigned) return builder->CreateURem(lval, rval);
+                        return builder->CreateSRem(lval, rval);
+                    }
+                    
+                    case AstType::BitAnd: return builder->CreateAnd(lval, rval);
+                    case AstType::BitOr: return builder->CreateOr(lval, rval);
+                    case AstType::BitXor: return builder->CreateXor(lval, rval);
+                    
+                    // The shift amount has to match the type of the value being shifted
+                    case AstType::Lsh: {
+                        rval = builder->CreateIntCast(rval, lval->getType(), false);
+                        return builder->CreateShl(lval, rval);
+                    }
+                    
+                    case AstType::Rsh: {
+                        rval = builder->CreateIntCast(rval, lval->getType(), false);
+                        if (isUnsigned) return builder->CreateLShr(lval, rval);
+                        return builder->CreateAShr(lval, rval);
+                    }
                     
                     case AstType::EQ: return builder->CreateICmpEQ(lval, rval);
                     case AstType::NEQ: return builder->CreateICmpNE(lval, rval);
-                    case AstType::GT: return builder->CreateICmpSGT(lval, rval);
-                    case AstType::LT: return builder->CreateICmpSLT(lval, rval);
-                    case AstType::GTE: return builder->CreateICmpSGE(lval, rval);
-                    case AstType::LTE: return builder->CreateICmpSLE(lval, rval);
+                    
+                    case AstType::GT: {
+                        if (cmpUnsigned) return builder->CreateICmpUGT(lval, rval);
+                        return builder->CreateICmpSGT(lval, rval);
+                    }
+                    
+                    case AstType::LT: {
+                        if (cmpUnsigned) return builder->CreateICmpULT(lval, rval);
+                        return builder->CreateICmpSLT(lval, rval);
+                    }
+                    
+                    case AstType::GTE: {
+                        if (cmpUnsigned) return builder->CreateICmpUGE(lval, rval);
+                        return builder->CreateICmpSGE(lval, rval);
+                    }
+                    
+                    case AstType::LTE: {
+                        if (cmpUnsigned) return builder->CreateICmpULE(lval, rval);
+                        return builder->CreateICmpSLE(lval, rval);
+                    }
                     
                     default: {}
                 }
@@ -561,7 +1086,14 @@ Type *Compiler::translateType(DataType dataType, DataType subType, std::string t
         
         case DataType::Array: {
             switch (subType) {
-                case DataType::Char: type = i8ArrayType; break;
+                case DataType::Bool: type = i1ArrayType; break;
+                
+                case DataType::Char:
+                case DataType::Byte:
+                case DataType::UByte: type = i8ArrayType; break;
+                
+                case DataType::Short:
+                case DataType::UShort: type = i16ArrayType; break;
                 
                 case DataType::UInt32:
                 case DataType::Int32: type = i32ArrayType; break;
@@ -569,6 +1101,9 @@ Type *Compiler::translateType(DataType dataType, DataType subType, std::string t
                 case DataType::Int64:
                 case DataType::UInt64: type = i64ArrayType; break;
                 
+                case DataType::Float: type = floatArrayType; break;
+                case DataType::Double: type = doubleArrayType; break;
+                
                 case DataType::String: type = strArrayType; break;
                 
                 default: {}
@@ -596,6 +1131,102 @@ Type *Compiler::translateType(DataType dataType, DataType subType, std::string t
     return type;
 }
 
+// Checks whether an expression produces an unsigned value
+// Literals have no sign of their own, so they follow whatever they are combined with
+bool Compiler::isUnsignedExpression(AstExpression *expr) {
+    switch (expr->getType()) {
+        case AstType::ID: {
+            AstID *id = static_cast<AstID *>(expr);
+            return isUnsignedType(typeTable[id->getValue()]);
+        }
+        
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            return isUnsignedType(ptrTable[acc->getValue()]);
+        }
+        
+        case AstType::StructAccess: {
+            AstStructAccess *sa = static_cast<AstStructAccess *>(expr);
+            std::string name = structVarTable[sa->getName()];
+            
+            for (auto s : tree->getStructs()) {
+                if (s->getName() != name) continue;
+                
+                for (Var member : s->getItems()) {
+                    if (member.name == sa->getMember()) return isUnsignedType(member.type);
+                }
+            }
+        } break;
+        
+        case AstType::Neg:
+        case AstType::BitNot: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            return isUnsignedExpression(op->getVal());
+        }
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Mod:
+        case AstType::BitAnd:
+        case AstType::BitOr:
+        case AstType::BitXor:
+        case AstType::Lsh:
+        case AstType::Rsh: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return isUnsignedExpression(op->getLVal()) || isUnsignedExpression(op->getRVal());
+        }
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+bool Compiler::isUnsignedType(DataType dataType) {
+    switch (dataType) {
+        case DataType::UByte:
+        case DataType::UShort:
+        case DataType::UInt32:
+        case DataType::UInt64: return true;
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Converts an integer to a different integer type
+// Unsigned values (and bools) are zero-extended, signed values are sign-extended
+Value *Compiler::castInt(Value *val, Type *type, bool isUnsigned) {
+    if (!val->getType()->isIntegerTy() || !type->isIntegerTy()) return val;
+    if (val->getType() == type) return val;
+    
+    if (val->getType()->isIntegerTy(1)) isUnsigned = true;
+    return builder->CreateIntCast(val, type, !isUnsigned);
+}
+
+// Converts a scalar to a different scalar type
+// This is castInt, plus conversions between integers and floating-point values.
+// isUnsigned is the signedness of the value, and toUnsigned that of the type.
+Value *Compiler::castValue(Value *val, Type *type, bool isUnsigned, bool toUnsigned) {
+    Type *valType = val->getType();
+    if (valType == type) return val;
+    
+    if (valType->isFloatingPointTy() && type->isFloatingPointTy()) {
+        return builder->CreateFPCast(val, type);
+    } else if (valType->isIntegerTy() && type->isFloatingPointTy()) {
+        if (isUnsigned || valType->isIntegerTy(1)) return builder->CreateUIToFP(val, type);
+        return builder->CreateSIToFP(val, type);
+    } else if (valType->isFloatingPointTy() && type->isIntegerTy()) {
+        if (toUnsigned) return builder->CreateFPToUI(val, type);
+        return builder->CreateFPToSI(val, type);
+    }
+    
+    return castInt(val, type, isUnsigned);
+}
+
 int Compiler::getStructIndex(std::string name, std::string member) {
     std::string name2 = structVarTable[name];
     if (name2 != "") name = name2;
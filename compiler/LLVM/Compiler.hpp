@@ -13,13 +13,33 @@ using namespace llvm;
 
 #include <string>
 #include <map>
+#include <set>
 #include <stack>
 
 #include <ast.hpp>
 
+// The largest array, in bytes, that can be moved to the stack
+const uint64_t MAX_STACK_ARRAY = 16 * 1024;
+
+// The size of an inline string buffer: the 24-byte header, 22 characters, and the
+// null, rounded up. This has to match SSO_MAX in corelib/str.c
+const uint64_t STR_BUFFER_SIZE = 48;
+
+// The longest literal a string is compared with inline, rather than by a call
+const size_t INLINE_COMPARE_MAX = 64;
+
 struct CFlags {
     std::string name;
     bool nvptx;
+    bool boundsCheck;
+};
+
+// An open arena block
+// It remembers the loop depth it was opened at, and the first string variable declared inside it
+struct ArenaScope {
+    Value *handle;
+    size_t loopDepth;
+    size_t firstVar;
 };
 
 class Compiler {
@@ -31,27 +51,91 @@ public:
     void writeAssembly();
     void assemble();
     void link();
+    bool hasErrors();
 protected:
+    void addError(std::string message);
     void compileStatement(AstStatement *stmt);
+    void compileGlobalVariable(AstGlobalVar *gv);
+    Constant *compileGlobalValue(AstGlobalVar *gv, AstExpression *expr, DataType dataType, Type *type);
+    bool isConstantExpression(AstExpression *expr);
     Value *compileValue(AstExpression *expr, DataType dataType = DataType::Void);
     Type *translateType(DataType dataType, DataType subType = DataType::Void, std::string typeName = "");
     int getStructIndex(std::string name, std::string member);
+    bool isUnsignedExpression(AstExpression *expr);
+    bool isUnsignedType(DataType dataType);
+    Value *castInt(Value *val, Type *type, bool isUnsigned);
+    Value *castValue(Value *val, Type *type, bool isUnsigned, bool toUnsigned = false);
 
     // Function.cpp
     void compileFunction(AstGlobalStatement *global);
     void compileExternFunction(AstGlobalStatement *global);
     void compileFuncCallStatement(AstStatement *stmt);
+    DataType argDataType(Function *callee, size_t index, AstExpression *expr);
+    Value *promoteVarArg(Value *val, bool isUnsigned);
     void compileReturnStatement(AstStatement *stmt);
+    Value *compileBuiltinCall(AstFuncCallExpr *fc);
+    void findEscapes(std::vector<AstStatement *> block);
+    void findEscapes(AstExpression *expr, bool isBorrowed = false);
+    bool isBorrowingCall(std::string name, bool usesResult);
+    AllocaInst *createEntryAlloca(Type *type);
+    AllocaInst *createOwnerFlag();
+    Value *takeOwnership(AstExpression *expr, Value *val);
+    bool canOwn(AllocaInst *var);
+    void freeTemporary(Value *val);
+    void freeIfOwned(Value *val, Value *owned);
+    void releaseString(Value *val, Value *owned);
+    bool canCapture(Function *callee);
+    void releaseArguments(std::vector<Value *> args);
+    void compileScopeExit();
+    void compileBoundsCheck(Value *index, Value *arrayPtr, bool isUnsigned);
+    BasicBlock *getTrapBlock();
+    bool isSafeIndex(std::string array, AstExpression *index);
     
     // Flow.cpp
     void compileIfStatement(AstStatement *stmt);
     void compileWhileStatement(AstStatement *stmt);
     void compileRepeatStatement(AstStatement *stmt);
     void compileForStatement(AstStatement *stmt);
+    void compileForLoop(AstForStmt *loop, AllocaInst *indexVar, bool isUnsigned, BasicBlock *loopEnd);
     void compileForAllStatement(AstStatement *stmt);
+    void compileMatchStatement(AstStatement *stmt);
+    void compileArenaStatement(AstStatement *stmt);
+    void compileArenaEnd(ArenaScope &scope, size_t lastVar);
+    void compileArenaExit(size_t loopDepth);
+    Value *compileLogicalOp(AstExpression *expr);
+    Value *convertToBool(Value *val);
+    bool isCheapExpression(AstExpression *expr);
+    void findIndexedArrays(std::vector<AstStatement *> block, std::string indexName, std::set<std::string> &arrays,
+                           std::set<std::string> &assigned);
+    void findIndexedArrays(AstExpression *expr, std::string indexName, std::set<std::string> &arrays, bool always = false);
+    void findAlwaysIndexed(std::vector<AstStatement *> block, std::string indexName, std::set<std::string> &arrays);
+    bool hasLoopExit(std::vector<AstStatement *> block, bool nested);
+    bool isLoopInvariant(AstExpression *expr, std::set<std::string> &assigned);
+    bool isMutableGlobal(std::string name);
+    
+    // String.cpp
+    Value *compileStringLiteral(std::string value);
+    bool isStringAppend(AstVarAssign *va);
+    void compileStringAppend(AstVarAssign *va);
+    Value *createStringBuffer();
+    Value *retainString(AstExpression *expr, Value *val, bool move);
+    bool isOrkaStringCall(Function *callee);
+    void compileStringUnique(AllocaInst *ptr);
+    bool isStringChain(AstExpression *expr);
+    void collectStringChain(AstExpression *expr, std::vector<AstExpression *> &pieces);
+    Value *compileStringChain(AstExpression *expr);
+    Value *compileStringLength(Value *str);
+    Value *compileStringEquals(Value *lval, Value *rval);
+    Value *compileLiteralEquals(Value *str, std::string literal);
+    
+    // Print.cpp
+    bool compilePrintCall(AstFuncCallStmt *fc);
+    bool parseFormat(std::string format, std::vector<std::string> &segments, std::string &specs);
+    void compileWriteBytes(std::string text);
 private:
     AstTree *tree;
     CFlags cflags;
+    int errorCount = 0;
 
     // LLVM stuff
     std::unique_ptr<LLVMContext> context;
@@ -61,20 +145,59 @@ private:
     DataType currentFuncType = DataType::Void;
     
     // The array types
+    StructType *i1ArrayType;
     StructType *i8ArrayType;
+    StructType *i16ArrayType;
     StructType *i32ArrayType;
     StructType *i64ArrayType;
+    StructType *floatArrayType;
+    StructType *doubleArrayType;
     StructType *strArrayType;
     
     // The user-defined structure table
     std::map<std::string, StructType*> structTable;
     std::map<std::string, std::string> structVarTable;
     
+    // Literals already emitted in this module, so each value is only emitted once
+    std::map<std::string, Constant *> stringPool;
+    std::map<std::string, Constant *> textPool;
+    
+    // The module's global variables, which every function starts out with
+    std::vector<AstGlobalVar *> globals;
+    std::map<std::string, GlobalVariable *> globalTable;
+    
     // Symbol table
     std::map<std::string, AllocaInst *> symtable;
     std::map<std::string, DataType> typeTable;
     std::map<std::string, DataType> ptrTable;
     
+    // Arrays in the current function that can't be moved to the stack,
+    // the ones that can't be freed when it returns, and the ones given away
+    std::set<std::string> escapeSet;
+    std::set<std::string> moveSet;
+    std::set<std::string> givenSet;
+    
+    // Functions that can keep an array passed to them, by storing or returning it
+    std::set<std::string> keepsArrays;
+    
+    // Heap ownership for the current function
+    // A string variable's flag is set while it holds a reference to its value.
+    std::map<AllocaInst *, AllocaInst *> ownerFlags;
+    std::vector<AllocaInst *> ownedArrays;
+    std::map<AllocaInst *, AllocaInst *> arrayFlags;
+    std::set<Value *> tempStrings;
+    std::map<AllocaInst *, Value *> inlineSlots;
+    
+    // Open arenas, and the strings declared inside them
+    std::vector<ArenaScope> arenaStack;
+    std::vector<AllocaInst *> arenaVars;
+    
+    // Bounds checking state for the current function
+    // The safe set maps a loop index to the arrays it is already known to be in bounds for
+    bool checkBounds = false;
+    BasicBlock *trapBlock = nullptr;
+    std::map<std::string, std::set<std::string>> safeIndexTable;
+    
     // Block stack
     int blockCount = 0;
     std::stack<BasicBlock *> breakStack;
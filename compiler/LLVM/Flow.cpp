@@ -3,8 +3,35 @@
 // This file is part of the Orka compiler.
 // Orka is licensed under the BSD-3 license. See the COPYING file for more information.
 //
+#include <iostream>
+#include <set>
+
 #include <LLVM/Compiler.hpp>
 
+// Mirrors strhash in the corelib; used to pick perfect hash seeds for string matches
+static uint32_t hashString(std::string str, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : str) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// Checks whether a seed sends every string to a different slot
+static bool isPerfectHash(std::vector<std::pair<std::string, BasicBlock *>> &strings, uint32_t seed, uint32_t tableSize) {
+    std::set<uint32_t> slots;
+    for (auto pair : strings) {
+        uint32_t slot = hashString(pair.first, seed) & (tableSize - 1);
+        if (!slots.insert(slot).second) return false;
+    }
+    return true;
+}
+
 // Translates an AST IF statement to LLVM
 void Compiler::compileIfStatement(AstStatement *stmt) {
     AstIfStmt *condStmt = static_cast<AstIfStmt *>(stmt);
@@ -158,40 +185,161 @@ void Compiler::compileRepeatStatement(AstStatement *stmt) {
 void Compiler::compileForStatement(AstStatement *stmt) {
     AstForStmt *loop = static_cast<AstForStmt *>(stmt);
     
-    BasicBlock *loopBlock = BasicBlock::Create(*context, "loop_body" + std::to_string(blockCount), currentFunc);
-    BasicBlock *loopInc = BasicBlock::Create(*context, "loop_inc" + std::to_string(blockCount), currentFunc);
-    BasicBlock *loopCmp = BasicBlock::Create(*context, "loop_cmp" + std::to_string(blockCount), currentFunc);
     BasicBlock *loopEnd = BasicBlock::Create(*context, "loop_end" + std::to_string(blockCount), currentFunc);
     ++blockCount;
-
-    BasicBlock *current = builder->GetInsertBlock();
-    loopBlock->moveAfter(current);
-    loopInc->moveAfter(loopBlock);
-    loopCmp->moveAfter(loopInc);
-    loopEnd->moveAfter(loopCmp);
-    
-    breakStack.push(loopEnd);
-    continueStack.push(loopCmp);
+    loopEnd->moveAfter(builder->GetInsertBlock());
     
     // Create the induction variable and back up the symbol tables
     std::map<std::string, AllocaInst *> symtableOld = symtable;
     std::map<std::string, DataType> typeTableOld = typeTable;
     
+    // The index is 64 bits wide so it can cover any array. It is unsigned if either
+    // bound is. Either way, it never wraps, so the increment is marked nuw or nsw to
+    // let LLVM reason about the trip count.
     std::string indexName = loop->getIndex()->getValue();
-    AllocaInst *indexVar = builder->CreateAlloca(Type::getInt32Ty(*context));
+    bool isUnsigned = isUnsignedExpression(loop->getStartBound()) || isUnsignedExpression(loop->getEndBound());
+    Type *indexType = Type::getInt64Ty(*context);
+    
+    AllocaInst *indexVar = builder->CreateAlloca(indexType);
     symtable[indexName] = indexVar;
-    typeTable[indexName] = DataType::Int32;
+    typeTable[indexName] = isUnsigned ? DataType::UInt64 : DataType::Int64;
     
     Value *startVal = compileValue(loop->getStartBound());
+    startVal = castInt(startVal, indexType, isUnsigned);
     builder->CreateStore(startVal, indexVar);
     
-    // Create the rest of the loop
+    // With bounds checking, accesses indexed directly by the loop index are checked
+    // once here instead of on every iteration. This needs an index and end bound the
+    // body never changes, and arrays the body never reassigns. Globals don't count, since
+    // any call in the body could change them. A loop that starts at a literal and runs
+    // to the size of the array needs no check at all.
+    //
+    // A failed check can only trap if the body would have trapped anyway: the array is
+    // indexed on every pass, and nothing leaves the loop early. Otherwise the loop is
+    // built twice, and a failed check runs the copy that still checks each access.
+    std::map<std::string, std::set<std::string>> safeIndexTableOld = safeIndexTable;
+    std::set<std::string> safeArrays, trapArrays;
+    Value *allInBounds = nullptr;
+    
+    if (checkBounds && (int)loop->getStep()->getValue() > 0) {
+        std::set<std::string> indexedArrays, assigned, alwaysIndexed;
+        findIndexedArrays(loop->getBlock(), indexName, indexedArrays, assigned);
+        if (!hasLoopExit(loop->getBlock(), false)) findAlwaysIndexed(loop->getBlock(), indexName, alwaysIndexed);
+        
+        if (assigned.find(indexName) == assigned.end() && isLoopInvariant(loop->getEndBound(), assigned)) {
+            Value *endOnce = nullptr;
+            
+            for (std::string array : indexedArrays) {
+                if (typeTable[array] != DataType::Array || assigned.find(array) != assigned.end()) continue;
+                if (isMutableGlobal(array)) continue;
+                safeArrays.insert(array);
+                
+                AstExpression *start = loop->getStartBound();
+                AstExpression *end = loop->getEndBound();
+                if ((start->getType() == AstType::IntL || start->getType() == AstType::QWordL)
+                    && end->getType() == AstType::Sizeof
+                    && static_cast<AstSizeof *>(end)->getValue()->getValue() == array) {
+                    trapArrays.insert(array);
+                    continue;
+                }
+                
+                if (endOnce == nullptr) {
+                    endOnce = compileValue(end);
+                    endOnce = castInt(endOnce, indexType, isUnsigned);
+                }
+                
+                Value *sizePtr = builder->CreateStructGEP(symtable[array], 1);
+                Value *size = builder->CreateLoad(sizePtr);
+                
+                // The loop either never runs, or runs over [start, end) within [0, size)
+                Value *inBounds;
+                if (isUnsigned) {
+                    inBounds = builder->CreateOr(builder->CreateICmpUGE(startVal, endOnce),
+                                                 builder->CreateICmpULE(endOnce, size));
+                } else {
+                    Value *inRange = builder->CreateAnd(builder->CreateICmpSGE(startVal, builder->getInt64(0)),
+                                                        builder->CreateICmpSLE(endOnce, size));
+                    inBounds = builder->CreateOr(builder->CreateICmpSGE(startVal, endOnce), inRange);
+                }
+                
+                if (alwaysIndexed.find(array) == alwaysIndexed.end()) {
+                    if (allInBounds) allInBounds = builder->CreateAnd(allInBounds, inBounds);
+                    else allInBounds = inBounds;
+                    continue;
+                }
+                
+                BasicBlock *okBlock = BasicBlock::Create(*context, "bounds_ok" + std::to_string(blockCount), currentFunc);
+                ++blockCount;
+                okBlock->moveBefore(loopEnd);
+                
+                builder->CreateCondBr(inBounds, okBlock, getTrapBlock());
+                builder->SetInsertPoint(okBlock);
+                trapArrays.insert(array);
+            }
+        }
+    }
+    
+    // The unchecked copy, and the checked one if some check can fail without trapping
+    BasicBlock *checkedBlock = nullptr;
+    if (allInBounds) {
+        BasicBlock *fastBlock = BasicBlock::Create(*context, "loop_fast" + std::to_string(blockCount), currentFunc);
+        checkedBlock = BasicBlock::Create(*context, "loop_checked" + std::to_string(blockCount), currentFunc);
+        ++blockCount;
+        fastBlock->moveBefore(loopEnd);
+        
+        builder->CreateCondBr(allInBounds, fastBlock, checkedBlock);
+        builder->SetInsertPoint(fastBlock);
+    }
+    
+    std::map<std::string, AllocaInst *> symtableLoop = symtable;
+    std::map<std::string, DataType> typeTableLoop = typeTable;
+    
+    safeIndexTable[indexName] = safeArrays;
+    compileForLoop(loop, indexVar, isUnsigned, loopEnd);
+    
+    if (checkedBlock) {
+        symtable = symtableLoop;
+        typeTable = typeTableLoop;
+        
+        checkedBlock->moveBefore(loopEnd);
+        builder->SetInsertPoint(checkedBlock);
+        safeIndexTable[indexName] = trapArrays;
+        compileForLoop(loop, indexVar, isUnsigned, loopEnd);
+    }
+    
+    builder->SetInsertPoint(loopEnd);
+    
+    symtable = symtableOld;
+    typeTable = typeTableOld;
+    safeIndexTable = safeIndexTableOld;
+}
+
+// Builds the compare, increment and body of a for loop from the current block
+// Every copy of a loop leaves through the same end block.
+void Compiler::compileForLoop(AstForStmt *loop, AllocaInst *indexVar, bool isUnsigned, BasicBlock *loopEnd) {
+    BasicBlock *loopBlock = BasicBlock::Create(*context, "loop_body" + std::to_string(blockCount), currentFunc);
+    BasicBlock *loopInc = BasicBlock::Create(*context, "loop_inc" + std::to_string(blockCount), currentFunc);
+    BasicBlock *loopCmp = BasicBlock::Create(*context, "loop_cmp" + std::to_string(blockCount), currentFunc);
+    ++blockCount;
+    
+    loopBlock->moveBefore(loopEnd);
+    loopInc->moveBefore(loopEnd);
+    loopCmp->moveBefore(loopEnd);
+    
+    breakStack.push(loopEnd);
+    continueStack.push(loopCmp);
+    
+    Type *indexType = indexVar->getAllocatedType();
     builder->CreateBr(loopCmp);
     builder->SetInsertPoint(loopCmp);
     
     Value *indexVal = builder->CreateLoad(indexVar);
     Value *endVal = compileValue(loop->getEndBound());
-    Value *cond = builder->CreateICmpSLT(indexVal, endVal);
+    endVal = castInt(endVal, indexType, isUnsigned);
+    
+    Value *cond;
+    if (isUnsigned) cond = builder->CreateICmpULT(indexVal, endVal);
+    else cond = builder->CreateICmpSLT(indexVal, endVal);
     builder->CreateCondBr(cond, loopBlock, loopEnd);
     
     // Loop increment
@@ -199,7 +347,9 @@ void Compiler::compileForStatement(AstStatement *stmt) {
     
     indexVal = builder->CreateLoad(indexVar);
     Value *incVal = compileValue(loop->getStep());
-    indexVal = builder->CreateAdd(indexVal, incVal);
+    incVal = castInt(incVal, indexType, isUnsignedExpression(loop->getStep()));
+    if (isUnsigned) indexVal = builder->CreateNUWAdd(indexVal, incVal);
+    else indexVal = builder->CreateNSWAdd(indexVal, incVal);
     builder->CreateStore(indexVal, indexVar);
     
     builder->CreateBr(loopCmp);
@@ -211,13 +361,251 @@ void Compiler::compileForStatement(AstStatement *stmt) {
     }
     builder->CreateBr(loopInc);
     
-    builder->SetInsertPoint(loopEnd);
-    
     breakStack.pop();
     continueStack.pop();
+}
+
+// Finds the arrays indexed directly by a loop index, and the variables assigned in a loop body
+void Compiler::findIndexedArrays(std::vector<AstStatement *> block, std::string indexName, std::set<std::string> &arrays,
+                                 std::set<std::string> &assigned) {
+    for (auto stmt : block) {
+        for (auto expr : stmt->getExpressions()) findIndexedArrays(expr, indexName, arrays);
+        
+        switch (stmt->getType()) {
+            case AstType::VarDec: {
+                AstVarDec *vd = static_cast<AstVarDec *>(stmt);
+                assigned.insert(vd->getName());
+            } break;
+            
+            case AstType::VarAssign: {
+                AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
+                assigned.insert(va->getName());
+            } break;
+            
+            case AstType::ArrayAssign: {
+                AstArrayAssign *pa = static_cast<AstArrayAssign *>(stmt);
+                AstExpression *index = pa->getExpressions().at(0);
+                if (index->getType() == AstType::ID && static_cast<AstID *>(index)->getValue() == indexName) {
+                    arrays.insert(pa->getName());
+                }
+            } break;
+            
+            case AstType::StructDec: {
+                AstStructDec *sd = static_cast<AstStructDec *>(stmt);
+                assigned.insert(sd->getVarName());
+            } break;
+            
+            case AstType::StructAssign: {
+                AstStructAssign *sa = static_cast<AstStructAssign *>(stmt);
+                assigned.insert(sa->getName());
+            } break;
+            
+            case AstType::If: {
+                AstIfStmt *condStmt = static_cast<AstIfStmt *>(stmt);
+                findIndexedArrays(condStmt->getBlock(), indexName, arrays, assigned);
+                findIndexedArrays(condStmt->getBranches(), indexName, arrays, assigned);
+            } break;
+            
+            case AstType::Match: {
+                AstMatchStmt *matchStmt = static_cast<AstMatchStmt *>(stmt);
+                findIndexedArrays(matchStmt->getBranches(), indexName, arrays, assigned);
+            } break;
+            
+            // Nested loop indexes are new variables, so they count as assignments
+            case AstType::For:
+            case AstType::ForAll: {
+                AstID *index;
+                if (stmt->getType() == AstType::For) index = static_cast<AstForStmt *>(stmt)->getIndex();
+                else index = static_cast<AstForAllStmt *>(stmt)->getIndex();
+                assigned.insert(index->getValue());
+                
+                AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+                findIndexedArrays(blockStmt->getBlock(), indexName, arrays, assigned);
+            } break;
+            
+            case AstType::Elif:
+            case AstType::Else:
+            case AstType::While:
+            case AstType::Repeat:
+            case AstType::Case:
+            case AstType::Arena: {
+                AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+                findIndexedArrays(blockStmt->getBlock(), indexName, arrays, assigned);
+            } break;
+            
+            default: {}
+        }
+    }
+}
+
+void Compiler::findIndexedArrays(AstExpression *expr, std::string indexName, std::set<std::string> &arrays, bool always) {
+    switch (expr->getType()) {
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            AstExpression *index = acc->getIndex();
+            if (index->getType() == AstType::ID && static_cast<AstID *>(index)->getValue() == indexName) {
+                arrays.insert(acc->getValue());
+            }
+            
+            findIndexedArrays(index, indexName, arrays, always);
+        } break;
+        
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            for (auto arg : fc->getArguments()) findIndexedArrays(arg, indexName, arrays, always);
+        } break;
+        
+        case AstType::Neg:
+        case AstType::Not:
+        case AstType::BitNot: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            findIndexedArrays(op->getVal(), indexName, arrays, always);
+        } break;
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Mod:
+        case AstType::BitAnd:
+        case AstType::BitOr:
+        case AstType::BitXor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE:
+        case AstType::And:
+        case AstType::Or: {
+            // The right side of and/or may not run
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            findIndexedArrays(op->getLVal(), indexName, arrays, always);
+            if (always && (expr->getType() == AstType::And || expr->getType() == AstType::Or)) break;
+            findIndexedArrays(op->getRVal(), indexName, arrays, always);
+        } break;
+        
+        default: {}
+    }
+}
+
+// Finds the arrays indexed directly by a loop index on every pass through a loop body
+// Only the statements of the body itself count; anything nested in another block may
+// not run. The caller makes sure nothing leaves the body early.
+void Compiler::findAlwaysIndexed(std::vector<AstStatement *> block, std::string indexName, std::set<std::string> &arrays) {
+    for (auto stmt : block) {
+        for (auto expr : stmt->getExpressions()) findIndexedArrays(expr, indexName, arrays, true);
+        
+        if (stmt->getType() == AstType::ArrayAssign) {
+            AstArrayAssign *pa = static_cast<AstArrayAssign *>(stmt);
+            AstExpression *index = pa->getExpressions().at(0);
+            if (index->getType() == AstType::ID && static_cast<AstID *>(index)->getValue() == indexName) {
+                arrays.insert(pa->getName());
+            }
+        }
+    }
+}
+
+// Checks whether a loop body can stop before its last statement
+// A break or continue in a nested loop only affects that loop, but a return leaves them all.
+bool Compiler::hasLoopExit(std::vector<AstStatement *> block, bool nested) {
+    for (auto stmt : block) {
+        switch (stmt->getType()) {
+            case AstType::Return: return true;
+            
+            case AstType::Break:
+            case AstType::Continue: {
+                if (!nested) return true;
+            } break;
+            
+            case AstType::If: {
+                AstIfStmt *condStmt = static_cast<AstIfStmt *>(stmt);
+                if (hasLoopExit(condStmt->getBlock(), nested)) return true;
+                if (hasLoopExit(condStmt->getBranches(), nested)) return true;
+            } break;
+            
+            case AstType::Match: {
+                AstMatchStmt *matchStmt = static_cast<AstMatchStmt *>(stmt);
+                if (hasLoopExit(matchStmt->getBranches(), nested)) return true;
+            } break;
+            
+            case AstType::Elif:
+            case AstType::Else:
+            case AstType::Case:
+            case AstType::Arena: {
+                AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+                if (hasLoopExit(blockStmt->getBlock(), nested)) return true;
+            } break;
+            
+            case AstType::While:
+            case AstType::Repeat:
+            case AstType::For:
+            case AstType::ForAll: {
+                AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+                if (hasLoopExit(blockStmt->getBlock(), true)) return true;
+            } break;
+            
+            default: {}
+        }
+    }
     
-    symtable = symtableOld;
-    typeTable = typeTableOld;
+    return false;
+}
+
+// Checks whether an expression gives the same value on every loop iteration
+// Only literals, local variables and sizeof qualify, so calls and memory reads are never
+// invariant. A global can be changed by any call in the loop.
+bool Compiler::isLoopInvariant(AstExpression *expr, std::set<std::string> &assigned) {
+    switch (expr->getType()) {
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL: return true;
+        
+        case AstType::ID: {
+            AstID *id = static_cast<AstID *>(expr);
+            if (isMutableGlobal(id->getValue())) return false;
+            return assigned.find(id->getValue()) == assigned.end();
+        }
+        
+        case AstType::Sizeof: {
+            AstSizeof *size = static_cast<AstSizeof *>(expr);
+            if (isMutableGlobal(size->getValue()->getValue())) return false;
+            return assigned.find(size->getValue()->getValue()) == assigned.end();
+        }
+        
+        case AstType::Neg:
+        case AstType::BitNot: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            return isLoopInvariant(op->getVal(), assigned);
+        }
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Lsh:
+        case AstType::Rsh: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return isLoopInvariant(op->getLVal(), assigned) && isLoopInvariant(op->getRVal(), assigned);
+        }
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Checks whether a name refers to a global that can be assigned
+bool Compiler::isMutableGlobal(std::string name) {
+    auto entry = symtable.find(name);
+    if (entry == symtable.end()) return false;
+    
+    GlobalVariable *global = dyn_cast<GlobalVariable>((Value *)entry->second);
+    return global && !global->isConstant();
 }
 
 // Translates a for-all loop to LLVM
@@ -258,8 +646,13 @@ void Compiler::compileForAllStatement(AstStatement *stmt) {
     symtable[indexName] = indexVar;
     typeTable[indexName] = indexType1;
     
-    AllocaInst *inductionVar = builder->CreateAlloca(Type::getInt32Ty(*context));
-    builder->CreateStore(builder->getInt32(0), inductionVar);
+    // The element is loaded by the loop itself, so it never needs a bounds check.
+    // The element variable hides any loop index of the same name.
+    std::map<std::string, std::set<std::string>> safeIndexTableOld = safeIndexTable;
+    safeIndexTable.erase(indexName);
+    
+    AllocaInst *inductionVar = builder->CreateAlloca(Type::getInt64Ty(*context));
+    builder->CreateStore(builder->getInt64(0), inductionVar);
     
     // The size value
     AllocaInst *arrayPtr = symtable[arrayName];
@@ -281,8 +674,9 @@ void Compiler::compileForAllStatement(AstStatement *stmt) {
     //
     builder->SetInsertPoint(loopInc);
     
+    // The index runs from 0 to the array size, so it can never wrap
     inductionVarVal = builder->CreateLoad(inductionVar);
-    inductionVarVal = builder->CreateAdd(inductionVarVal, builder->getInt32(1));
+    inductionVarVal = builder->CreateAdd(inductionVarVal, builder->getInt64(1), "", true, true);
     builder->CreateStore(inductionVarVal, inductionVar);
     
     builder->CreateBr(loopCmp);
@@ -318,4 +712,338 @@ void Compiler::compileForAllStatement(AstStatement *stmt) {
     
     symtable = symtableOld;
     typeTable = typeTableOld;
+    safeIndexTable = safeIndexTableOld;
+}
+
+// Translates a match statement to LLVM
+//
+// Integer, character, and enum matches become a single switch instruction, which
+// LLVM lowers to a jump table or a binary search. String matches hash the value with
+// a seed chosen here so that every case string lands in its own slot. We switch on
+// the slot, and confirm the match with a single string comparison.
+void Compiler::compileMatchStatement(AstStatement *stmt) {
+    AstMatchStmt *match = static_cast<AstMatchStmt *>(stmt);
+    
+    BasicBlock *endBlock = BasicBlock::Create(*context, "match_end" + std::to_string(blockCount), currentFunc);
+    BasicBlock *defaultBlock = endBlock;
+    int matchNum = blockCount;
+    ++blockCount;
+    
+    // Create a block for each case
+    std::vector<std::pair<AstBlockStmt *, BasicBlock *>> caseBlocks;
+    AstElseStmt *elseStmt = nullptr;
+    BasicBlock *current = builder->GetInsertBlock();
+    
+    for (auto branch : match->getBranches()) {
+        if (branch->getType() == AstType::Else) {
+            elseStmt = static_cast<AstElseStmt *>(branch);
+            continue;
+        }
+        
+        std::string name = "case" + std::to_string(matchNum) + "_" + std::to_string(caseBlocks.size());
+        BasicBlock *caseBlock = BasicBlock::Create(*context, name, currentFunc);
+        caseBlock->moveAfter(current);
+        current = caseBlock;
+        
+        caseBlocks.push_back(std::pair<AstBlockStmt *, BasicBlock *>(static_cast<AstBlockStmt *>(branch), caseBlock));
+    }
+    
+    if (elseStmt != nullptr) {
+        defaultBlock = BasicBlock::Create(*context, "match_default" + std::to_string(matchNum), currentFunc);
+        defaultBlock->moveAfter(current);
+        current = defaultBlock;
+        caseBlocks.push_back(std::pair<AstBlockStmt *, BasicBlock *>(elseStmt, defaultBlock));
+    }
+    
+    endBlock->moveAfter(current);
+    
+    // Check the case values to see what kind of match this is
+    bool strMatch = false;
+    int valueCount = 0;
+    
+    for (auto branch : match->getBranches()) {
+        if (branch->getType() != AstType::Case) continue;
+        
+        for (auto expr : branch->getExpressions()) {
+            if (expr->getType() == AstType::StringL) strMatch = true;
+            ++valueCount;
+        }
+    }
+    
+    Value *cond = compileValue(match->getExpression());
+    
+    if (strMatch) {
+        // Collect the case strings and their blocks
+        std::vector<std::pair<std::string, BasicBlock *>> strCases;
+        std::set<std::string> seen;
+        
+        for (auto pair : caseBlocks) {
+            if (pair.first->getType() != AstType::Case) continue;
+            
+            for (auto expr : pair.first->getExpressions()) {
+                if (expr->getType() != AstType::StringL) {
+                    addError("Expected string literal in case.");
+                    continue;
+                }
+                
+                std::string value = static_cast<AstString *>(expr)->getValue();
+                if (seen.find(value) != seen.end()) continue;
+                seen.insert(value);
+                
+                strCases.push_back(std::pair<std::string, BasicBlock *>(value, pair.second));
+            }
+        }
+        
+        // Find a table size and seed that give each string its own slot
+        uint32_t tableSize = 1;
+        while (tableSize < strCases.size()) tableSize *= 2;
+        
+        uint32_t seed = 0;
+        for (;;) {
+            bool found = false;
+            for (seed = 0; seed < 1024 && !found; seed++) {
+                found = isPerfectHash(strCases, seed, tableSize);
+            }
+            
+            if (found) {
+                --seed;
+                break;
+            }
+            tableSize *= 2;
+        }
+        
+        // Hash and dispatch
+        Function *strhash = mod->getFunction("strhash");
+        if (!strhash) std::cerr << "Error: Corelib function \"strhash\" not found." << std::endl;
+        
+        std::vector<Value *> args;
+        args.push_back(cond);
+        args.push_back(builder->getInt32(seed));
+        
+        Value *hash = builder->CreateCall(strhash, args);
+        Value *slot = builder->CreateAnd(hash, builder->getInt32(tableSize - 1));
+        SwitchInst *sw = builder->CreateSwitch(slot, defaultBlock, strCases.size());
+        
+        // Each slot confirms the match with one comparison
+        for (auto pair : strCases) {
+            uint32_t slotNum = hashString(pair.first, seed) & (tableSize - 1);
+            
+            BasicBlock *cmpBlock = BasicBlock::Create(*context, "match_cmp" + std::to_string(matchNum), currentFunc);
+            cmpBlock->moveBefore(pair.second);
+            sw->addCase(builder->getInt32(slotNum), cmpBlock);
+            
+            builder->SetInsertPoint(cmpBlock);
+            
+            Value *isEqual = compileLiteralEquals(cond, pair.first);
+            builder->CreateCondBr(isEqual, pair.second, defaultBlock);
+        }
+    } else {
+        SwitchInst *sw = builder->CreateSwitch(cond, defaultBlock, valueCount);
+        IntegerType *condType = dyn_cast<IntegerType>(cond->getType());
+        
+        for (auto pair : caseBlocks) {
+            if (pair.first->getType() != AstType::Case) continue;
+            
+            for (auto expr : pair.first->getExpressions()) {
+                ConstantInt *value = dyn_cast<ConstantInt>(compileValue(expr));
+                if (value == nullptr || condType == nullptr) {
+                    addError("Expected constant value in case.");
+                    continue;
+                }
+                
+                // Literals are built as 32-bit; fit them to the matched type
+                // A value that doesn't fit would alias another case once truncated
+                if (value->getType() != condType) {
+                    int64_t num = isUnsignedExpression(expr) ? value->getZExtValue() : value->getSExtValue();
+                    unsigned width = condType->getBitWidth();
+                    
+                    if (width < 64) {
+                        int64_t min = 0;
+                        int64_t max = (INT64_C(1) << width) - 1;
+                        if (!isUnsignedExpression(match->getExpression())) {
+                            min = -(INT64_C(1) << (width - 1));
+                            max = (INT64_C(1) << (width - 1)) - 1;
+                        }
+                        
+                        if (num < min || num > max) {
+                            addError("Case value " + std::to_string(num) + " does not fit the matched type.");
+                            continue;
+                        }
+                    }
+                    
+                    value = ConstantInt::get(condType, num);
+                }
+                
+                // Duplicate values go to the first case that names them
+                if (sw->findCaseValue(value) != sw->case_default()) continue;
+                sw->addCase(value, pair.second);
+            }
+        }
+    }
+    
+    // Compile the bodies
+    for (auto pair : caseBlocks) {
+        builder->SetInsertPoint(pair.second);
+        
+        for (auto stmt2 : pair.first->getBlock()) {
+            compileStatement(stmt2);
+        }
+        
+        if (builder->GetInsertBlock()->getTerminator() == nullptr) {
+            builder->CreateBr(endBlock);
+        }
+    }
+    
+    builder->SetInsertPoint(endBlock);
+}
+
+//
+// Translates an arena block to LLVM
+// While the block runs, the runtime serves every allocation from the arena. The
+// arena ends when control leaves the block, whether by falling out, break, continue,
+// or return. Nothing allocated inside may be used after that.
+//
+void Compiler::compileArenaStatement(AstStatement *stmt) {
+    AstArenaStmt *arena = static_cast<AstArenaStmt *>(stmt);
+    
+    Function *beginFunc = mod->getFunction("arena_begin");
+    Value *handle = builder->CreateCall(beginFunc);
+    arenaStack.push_back({ handle, breakStack.size(), arenaVars.size() });
+    
+    for (auto stmt2 : arena->getBlock()) {
+        compileStatement(stmt2);
+    }
+    
+    if (builder->GetInsertBlock()->getTerminator() == nullptr) {
+        compileArenaEnd(arenaStack.back(), arenaVars.size());
+    }
+    
+    arenaVars.resize(arenaStack.back().firstVar);
+    arenaStack.pop_back();
+}
+
+// Ends one arena
+// Strings declared inside can own arena memory, so they drop their references first
+void Compiler::compileArenaEnd(ArenaScope &scope, size_t lastVar) {
+    for (size_t i = scope.firstVar; i<lastVar; i++) {
+        AllocaInst *var = arenaVars.at(i);
+        releaseString(builder->CreateLoad(var), builder->CreateLoad(ownerFlags[var]));
+        builder->CreateStore(builder->getInt1(false), ownerFlags[var]);
+    }
+    
+    Function *endFunc = mod->getFunction("arena_end");
+    builder->CreateCall(endFunc, scope.handle);
+}
+
+// Ends the arenas opened inside the loop at the given depth, innermost first
+// This doesn't close them for the compiler; the code after a jump still runs inside them.
+void Compiler::compileArenaExit(size_t loopDepth) {
+    size_t lastVar = arenaVars.size();
+    
+    for (auto it = arenaStack.rbegin(); it != arenaStack.rend(); it++) {
+        if (it->loopDepth < loopDepth) break;
+        compileArenaEnd(*it, lastVar);
+        lastVar = it->firstVar;
+    }
+}
+
+// Translates a logical AND or OR operation to LLVM
+//
+// The right side is only evaluated when it can change the result. If it is
+// cheap and has no side effects, we evaluate both sides and use a select
+// instead, which keeps hot conditions free of branches.
+Value *Compiler::compileLogicalOp(AstExpression *expr) {
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    bool isOr = op->getType() == AstType::Or;
+    
+    Value *lval = convertToBool(compileValue(op->getLVal()));
+    
+    if (isCheapExpression(op->getRVal())) {
+        Value *rval = convertToBool(compileValue(op->getRVal()));
+        if (isOr) return builder->CreateSelect(lval, builder->getInt1(true), rval);
+        return builder->CreateSelect(lval, rval, builder->getInt1(false));
+    }
+    
+    BasicBlock *lvalBlock = builder->GetInsertBlock();
+    BasicBlock *rvalBlock = BasicBlock::Create(*context, "logic_rval" + std::to_string(blockCount), currentFunc);
+    BasicBlock *mergeBlock = BasicBlock::Create(*context, "logic_end" + std::to_string(blockCount), currentFunc);
+    ++blockCount;
+    
+    rvalBlock->moveAfter(lvalBlock);
+    mergeBlock->moveAfter(rvalBlock);
+    
+    if (isOr) builder->CreateCondBr(lval, mergeBlock, rvalBlock);
+    else builder->CreateCondBr(lval, rvalBlock, mergeBlock);
+    
+    builder->SetInsertPoint(rvalBlock);
+    Value *rval = convertToBool(compileValue(op->getRVal()));
+    rvalBlock = builder->GetInsertBlock();
+    builder->CreateBr(mergeBlock);
+    
+    builder->SetInsertPoint(mergeBlock);
+    PHINode *phi = builder->CreatePHI(Type::getInt1Ty(*context), 2);
+    phi->addIncoming(builder->getInt1(isOr), lvalBlock);
+    phi->addIncoming(rval, rvalBlock);
+    return phi;
+}
+
+// Turns a value into an i1 so it can be used as a condition
+Value *Compiler::convertToBool(Value *val) {
+    Type *type = val->getType();
+    
+    if (type->isIntegerTy(1)) return val;
+    if (type->isIntegerTy()) return builder->CreateICmpNE(val, ConstantInt::get(type, 0));
+    if (type->isFloatingPointTy()) return builder->CreateFCmpONE(val, ConstantFP::get(type, 0.0));
+    if (type->isPointerTy()) return builder->CreateIsNotNull(val);
+    return val;
+}
+
+// Checks if an expression can be evaluated even when a short-circuit would skip it
+// Function calls may have side effects, array accesses may be guarded by the other
+// side, and division may trap, so none of those count.
+bool Compiler::isCheapExpression(AstExpression *expr) {
+    switch (expr->getType()) {
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL:
+        case AstType::FloatL:
+        case AstType::ID:
+        case AstType::StructAccess: return true;
+        
+        case AstType::Neg:
+        case AstType::Not: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            return isCheapExpression(op->getVal());
+        }
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE:
+        case AstType::And:
+        case AstType::Or: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            AstExpression *lval = op->getLVal();
+            AstExpression *rval = op->getRVal();
+            
+            // String operations turn into corelib calls
+            if (lval->getType() == AstType::StringL || rval->getType() == AstType::StringL) return false;
+            if (lval->getType() == AstType::ID && typeTable[static_cast<AstID *>(lval)->getValue()] == DataType::String)
+                return false;
+            
+            return isCheapExpression(lval) && isCheapExpression(rval);
+        }
+        
+        default: {}
+    }
+    
+    return false;
 }
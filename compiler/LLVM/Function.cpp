@@ -3,6 +3,8 @@
 // This file is part of the Orka compiler.
 // Orka is licensed under the BSD-3 license. See the COPYING file for more information.
 //
+#include "llvm/IR/Intrinsics.h"
+
 #include <iostream>
 
 #include <LLVM/Compiler.hpp>
@@ -51,6 +53,39 @@ void Compiler::compileFunction(AstGlobalStatement *global) {
     BasicBlock *mainBlock = BasicBlock::Create(*context, "entry", func);
     builder->SetInsertPoint(mainBlock);
     
+    // Find the arrays that can't live on the stack, and the ones we can't free
+    escapeSet.clear();
+    moveSet.clear();
+    givenSet.clear();
+    findEscapes(astFunc->getBlock()->getBlock());
+    
+    // An array parameter named as a value (stored in a global or a field, returned,
+    // or handed to a call that keeps it) can outlive the call, so callers can't free it
+    for (auto var : astVarArgs) {
+        if (var.type == DataType::Array && moveSet.find(var.name) != moveSet.end()) {
+            keepsArrays.insert(astFunc->getName());
+        }
+    }
+    
+    ownerFlags.clear();
+    ownedArrays.clear();
+    arrayFlags.clear();
+    tempStrings.clear();
+    inlineSlots.clear();
+    arenaStack.clear();
+    arenaVars.clear();
+    
+    checkBounds = cflags.boundsCheck && !astFunc->isUnchecked();
+    trapBlock = nullptr;
+    safeIndexTable.clear();
+    
+    // The globals are reached through the same paths as locals
+    for (auto gv : globals) {
+        symtable[gv->getName()] = (AllocaInst *)globalTable[gv->getName()];
+        typeTable[gv->getName()] = gv->getDataType();
+        ptrTable[gv->getName()] = gv->getPtrType();
+    }
+    
     // Load and store any arguments
     if (astVarArgs.size() > 0) {
         for (int i = 0; i<astVarArgs.size(); i++) {
@@ -74,6 +109,12 @@ void Compiler::compileFunction(AstGlobalStatement *global) {
             // Store the variable
             Value *param = func->getArg(i);
             builder->CreateStore(param, alloca);
+            
+            // String parameters are borrowed, but hold a reference to whatever is assigned to them later
+            if (var.type == DataType::String) {
+                ownerFlags[alloca] = createOwnerFlag();
+                inlineSlots[alloca] = createStringBuffer();
+            }
         }
     }
 
@@ -88,13 +129,16 @@ void Compiler::compileFunction(AstGlobalStatement *global) {
 void Compiler::compileExternFunction(AstGlobalStatement *global) {
     AstExternFunction *astFunc = static_cast<AstExternFunction *>(global);
     
+    // Runtime functions the compiler already declared keep their declaration
+    if (mod->getFunction(astFunc->getName())) return;
+    
     std::vector<Var> astVarArgs = astFunc->getArguments();
     FunctionType *FT;
     
     Type *retType = translateType(astFunc->getDataType());
     
     if (astVarArgs.size() == 0) {
-        FT = FunctionType::get(retType, false);
+        FT = FunctionType::get(retType, astFunc->isVarArgs());
     } else {
         std::vector<Type *> args;
         for (auto var : astVarArgs) {
@@ -102,7 +146,7 @@ void Compiler::compileExternFunction(AstGlobalStatement *global) {
             args.push_back(type);
         }
         
-        FT = FunctionType::get(retType, args, false);
+        FT = FunctionType::get(retType, args, astFunc->isVarArgs());
     }
     
     Function::Create(FT, Function::ExternalLinkage, astFunc->getName(), mod.get());
@@ -117,15 +161,54 @@ void Compiler::compileExternFunction(AstGlobalStatement *global) {
 void Compiler::compileFuncCallStatement(AstStatement *stmt) {
     AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
     std::vector<Value *> args;
+    if (compilePrintCall(fc)) return;
+    
+    Function *callee = mod->getFunction(fc->getName());
+    if (!callee) {
+        std::cerr << "Error: Invalid function call statement: \"" << fc->getName() << "\"." << std::endl;
+        return;
+    }
+    bool captures = canCapture(callee);
     
+    // Integer arguments are extended or truncated to the parameter type
     for (auto stmt : stmt->getExpressions()) {
-        Value *val = compileValue(stmt);
+        Value *val = compileValue(stmt, argDataType(callee, args.size(), stmt));
+        if (args.size() < callee->arg_size()) {
+            Type *argType = callee->getArg(args.size())->getType();
+            val = castInt(val, argType, isUnsignedExpression(stmt));
+        } else if (callee->isVarArg()) {
+            val = promoteVarArg(val, isUnsignedExpression(stmt));
+        }
+        if (captures) val = retainString(stmt, val, true);
         args.push_back(val);
     }
     
-    Function *callee = mod->getFunction(fc->getName());
-    if (!callee) std::cerr << "Invalid function call statement." << std::endl;
-    builder->CreateCall(callee, args);
+    Value *call = builder->CreateCall(callee, args);
+    releaseArguments(args);
+    
+    // Nothing uses the returned string, so its reference is dropped right away
+    if (isOrkaStringCall(callee) && arenaStack.empty()) {
+        releaseString(call, builder->getInt1(true));
+    }
+}
+
+// Gets the type to build an argument with
+// A float literal passed as a double (or as a variable argument) is built as a
+// double, so it keeps every digit.
+DataType Compiler::argDataType(Function *callee, size_t index, AstExpression *expr) {
+    if (expr->getType() != AstType::FloatL) return DataType::Void;
+    if (index >= callee->arg_size()) return callee->isVarArg() ? DataType::Double : DataType::Void;
+    if (callee->getArg(index)->getType()->isDoubleTy()) return DataType::Double;
+    return DataType::Void;
+}
+
+// Widens a variable argument the way the corelib reads it back
+// Integers become 64 bits and floats become doubles.
+Value *Compiler::promoteVarArg(Value *val, bool isUnsigned) {
+    Type *type = val->getType();
+    if (type->isFloatTy()) return builder->CreateFPExt(val, Type::getDoubleTy(*context));
+    if (type->isIntegerTy()) return castInt(val, Type::getInt64Ty(*context), isUnsigned);
+    return val;
 }
 
 //
@@ -134,17 +217,397 @@ void Compiler::compileFuncCallStatement(AstStatement *stmt) {
 //
 void Compiler::compileReturnStatement(AstStatement *stmt) {
     if (stmt->getExpressionCount() == 0) {
+        compileScopeExit();
         builder->CreateRetVoid();
     } else if (stmt->getExpressionCount() == 1) {
-        Value *val = compileValue(stmt->getExpressions().at(0), currentFuncType);
+        AstExpression *expr = stmt->getExpressions().at(0);
+        Value *val = compileValue(expr, currentFuncType);
+        
+        // The caller gets a reference to a returned string
+        val = retainString(expr, val, true);
+        
         if (currentFuncType == DataType::Struct) {
             Value *ld = builder->CreateLoad(val);
+            compileScopeExit();
             builder->CreateRet(ld);
         } else {
+            val = castInt(val, currentFunc->getReturnType(), isUnsignedExpression(expr));
+            compileScopeExit();
             builder->CreateRet(val);
         }
     } else {
+        compileScopeExit();
         builder->CreateRetVoid();
     }
 }
 
+//
+// Compiles calls to the bit manipulation builtins
+// These map directly to LLVM intrinsics. Returns nullptr if the call is not a
+// builtin, or if the program defines its own function with the same name.
+//
+Value *Compiler::compileBuiltinCall(AstFuncCallExpr *fc) {
+    std::string name = fc->getName();
+    std::vector<AstExpression *> astArgs = fc->getArguments();
+    
+    if (mod->getFunction(name)) return nullptr;
+    if (name != "popcount" && name != "clz" && name != "ctz" && name != "bswap"
+        && name != "rotl" && name != "rotr") return nullptr;
+    
+    if (astArgs.size() == 0) {
+        std::cerr << "Error: Expected argument to builtin \"" << name << "\"." << std::endl;
+        return nullptr;
+    }
+    
+    Value *val = compileValue(astArgs.at(0));
+    Type *type = val->getType();
+    
+    if (name == "popcount") {
+        Function *intrinsic = Intrinsic::getDeclaration(mod.get(), Intrinsic::ctpop, type);
+        return builder->CreateCall(intrinsic, val);
+    } else if (name == "clz" || name == "ctz") {
+        Intrinsic::ID id = Intrinsic::ctlz;
+        if (name == "ctz") id = Intrinsic::cttz;
+        
+        // Zero is defined to return the width of the type
+        Function *intrinsic = Intrinsic::getDeclaration(mod.get(), id, type);
+        return builder->CreateCall(intrinsic, { val, builder->getInt1(false) });
+    } else if (name == "bswap") {
+        // A single byte has nothing to swap
+        if (type->isIntegerTy(8)) return val;
+        
+        Function *intrinsic = Intrinsic::getDeclaration(mod.get(), Intrinsic::bswap, type);
+        return builder->CreateCall(intrinsic, val);
+    }
+    
+    // Rotates are funnel shifts with both inputs the same
+    if (astArgs.size() < 2) {
+        std::cerr << "Error: Expected rotate amount to builtin \"" << name << "\"." << std::endl;
+        return nullptr;
+    }
+    
+    Value *amount = compileValue(astArgs.at(1));
+    amount = builder->CreateIntCast(amount, type, false);
+    
+    Intrinsic::ID id = Intrinsic::fshl;
+    if (name == "rotr") id = Intrinsic::fshr;
+    
+    Function *intrinsic = Intrinsic::getDeclaration(mod.get(), id, type);
+    return builder->CreateCall(intrinsic, { val, val, amount });
+}
+
+//
+// Finds the arrays that escape the current function
+// Arrays are only ever used in place (indexing, sizeof, forall) unless they are
+// named as a value. That happens when an array is returned, passed to a function,
+// or assigned somewhere else, so any array named in an expression escapes.
+//
+// Arrays that are only lent to a call (and can't come back through its return
+// value) are still ours to free. Anything else named, or reassigned, goes in the
+// move set.
+//
+void Compiler::findEscapes(std::vector<AstStatement *> block) {
+    for (auto stmt : block) {
+        bool borrows = false;
+        if (stmt->getType() == AstType::FuncCallStmt) {
+            AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
+            borrows = isBorrowingCall(fc->getName(), false);
+        }
+        for (auto expr : stmt->getExpressions()) findEscapes(expr, borrows);
+        
+        switch (stmt->getType()) {
+            case AstType::VarAssign: {
+                AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
+                moveSet.insert(va->getName());
+            } break;
+            
+            case AstType::If: {
+                AstIfStmt *condStmt = static_cast<AstIfStmt *>(stmt);
+                findEscapes(condStmt->getBlock());
+                findEscapes(condStmt->getBranches());
+            } break;
+            
+            case AstType::Match: {
+                AstMatchStmt *matchStmt = static_cast<AstMatchStmt *>(stmt);
+                findEscapes(matchStmt->getBranches());
+            } break;
+            
+            case AstType::For: {
+                AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+                findEscapes(loop->getStartBound());
+                findEscapes(loop->getEndBound());
+                findEscapes(loop->getBlock());
+            } break;
+            
+            case AstType::Elif:
+            case AstType::Else:
+            case AstType::While:
+            case AstType::Repeat:
+            case AstType::ForAll:
+            case AstType::Case:
+            case AstType::Arena: {
+                AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+                findEscapes(blockStmt->getBlock());
+            } break;
+            
+            default: {}
+        }
+    }
+}
+
+void Compiler::findEscapes(AstExpression *expr, bool isBorrowed) {
+    switch (expr->getType()) {
+        case AstType::ID: {
+            AstID *id = static_cast<AstID *>(expr);
+            escapeSet.insert(id->getValue());
+            if (!isBorrowed) {
+                moveSet.insert(id->getValue());
+                givenSet.insert(id->getValue());
+            }
+        } break;
+        
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            findEscapes(acc->getIndex());
+        } break;
+        
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            bool borrows = isBorrowingCall(fc->getName(), true);
+            for (auto arg : fc->getArguments()) findEscapes(arg, borrows);
+        } break;
+        
+        case AstType::Neg:
+        case AstType::Not:
+        case AstType::BitNot: {
+            AstUnaryOp *op = static_cast<AstUnaryOp *>(expr);
+            findEscapes(op->getVal());
+        } break;
+        
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Mod:
+        case AstType::BitAnd:
+        case AstType::BitOr:
+        case AstType::BitXor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE:
+        case AstType::And:
+        case AstType::Or: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            findEscapes(op->getLVal());
+            findEscapes(op->getRVal());
+        } break;
+        
+        default: {}
+    }
+}
+
+//
+// Checks an array index against the length stored in the array structure
+// Negative indexes are caught by the same unsigned comparison. All failed checks in
+// a function branch to a single trap block.
+//
+void Compiler::compileBoundsCheck(Value *index, Value *arrayPtr, bool isUnsigned) {
+    Value *sizePtr = builder->CreateStructGEP(arrayPtr, 1);
+    Value *size = builder->CreateLoad(sizePtr);
+    index = castInt(index, size->getType(), isUnsigned);
+    
+    BasicBlock *okBlock = BasicBlock::Create(*context, "bounds_ok" + std::to_string(blockCount), currentFunc);
+    ++blockCount;
+    
+    Value *inBounds = builder->CreateICmpULT(index, size);
+    builder->CreateCondBr(inBounds, okBlock, getTrapBlock());
+    builder->SetInsertPoint(okBlock);
+}
+
+// Returns the block failed bounds checks jump to, creating it if needed
+BasicBlock *Compiler::getTrapBlock() {
+    if (trapBlock != nullptr) return trapBlock;
+    
+    trapBlock = BasicBlock::Create(*context, "bounds_trap", currentFunc);
+    IRBuilder<> trapBuilder(trapBlock);
+    
+    // Output is buffered, so whatever came before the failure is written first
+    Function *flushFunc = mod->getFunction("flush");
+    trapBuilder.CreateCall(flushFunc);
+    
+    Function *trap = Intrinsic::getDeclaration(mod.get(), Intrinsic::trap);
+    trapBuilder.CreateCall(trap);
+    trapBuilder.CreateUnreachable();
+    return trapBlock;
+}
+
+// Checks whether an index is a loop index already known to be in bounds for an array
+bool Compiler::isSafeIndex(std::string array, AstExpression *index) {
+    if (index->getType() != AstType::ID) return false;
+    
+    AstID *id = static_cast<AstID *>(index);
+    if (safeIndexTable.find(id->getValue()) == safeIndexTable.end()) return false;
+    
+    std::set<std::string> arrays = safeIndexTable[id->getValue()];
+    return arrays.find(array) != arrays.end();
+}
+
+// Checks whether a call only borrows the arrays passed to it
+// It can't keep one unless it returns it, stores it somewhere that outlives the call,
+// or has a structure to put it in. Functions that aren't defined yet could do anything.
+bool Compiler::isBorrowingCall(std::string name, bool usesResult) {
+    Function *callee = mod->getFunction(name);
+    if (!callee) return false;
+    if (keepsArrays.find(name) != keepsArrays.end()) return false;
+    if (usesResult && callee->getReturnType()->isStructTy()) return false;
+    
+    for (auto &param : callee->args()) {
+        Type *type = param.getType();
+        if (type->isPointerTy() && type->getPointerElementType()->isStructTy()) return false;
+    }
+    
+    return true;
+}
+
+//
+// Heap ownership
+//
+// Heap arrays belong to the function that declares them, unless they escape. String
+// variables carry a runtime flag saying whether they own their current value, since
+// the same variable can hold a literal on one path and a concatenation on another.
+// Ownership moves with assignment and return. Everything still owned is freed when
+// the function returns, and an owned string is freed when its variable is overwritten.
+//
+// Strings built by concatenation start out as temporaries. A temporary that is only
+// read (an operand, a comparison, a call argument) is freed right after its use.
+//
+
+// Creates an alloca in the entry block
+// Allocas there are only run once, no matter where the declaration is
+AllocaInst *Compiler::createEntryAlloca(Type *type) {
+    BasicBlock *entry = &currentFunc->getEntryBlock();
+    IRBuilder<> entryBuilder(entry, entry->begin());
+    return entryBuilder.CreateAlloca(type);
+}
+
+// Creates an ownership flag, cleared at the start of the function
+AllocaInst *Compiler::createOwnerFlag() {
+    BasicBlock *entry = &currentFunc->getEntryBlock();
+    IRBuilder<> entryBuilder(entry, entry->begin());
+    AllocaInst *flag = entryBuilder.CreateAlloca(Type::getInt1Ty(*context));
+    entryBuilder.CreateStore(entryBuilder.getInt1(false), flag);
+    return flag;
+}
+
+// Takes ownership of a string value, returning whether there was anything to take
+// Temporaries are always owned. An owned variable gives up its ownership.
+Value *Compiler::takeOwnership(AstExpression *expr, Value *val) {
+    if (tempStrings.find(val) != tempStrings.end()) {
+        tempStrings.erase(val);
+        return builder->getInt1(true);
+    }
+    
+    if (expr->getType() == AstType::ID) {
+        AstID *id = static_cast<AstID *>(expr);
+        AllocaInst *var = symtable[id->getValue()];
+        
+        if (ownerFlags.find(var) != ownerFlags.end()) {
+            AllocaInst *flag = ownerFlags[var];
+            Value *owned = builder->CreateLoad(flag);
+            builder->CreateStore(builder->getInt1(false), flag);
+            return owned;
+        }
+    }
+    
+    return builder->getInt1(false);
+}
+
+// Checks whether a string variable can own memory allocated right now
+// Inside an arena, only the variables declared in that arena can.
+bool Compiler::canOwn(AllocaInst *var) {
+    if (arenaStack.empty()) return true;
+    
+    for (size_t i = arenaStack.back().firstVar; i<arenaVars.size(); i++) {
+        if (arenaVars.at(i) == var) return true;
+    }
+    return false;
+}
+
+// Releases a string temporary once it has been used
+// Short ones were built in their inline buffer, and the runtime ignores them
+void Compiler::freeTemporary(Value *val) {
+    if (tempStrings.find(val) == tempStrings.end()) return;
+    tempStrings.erase(val);
+    if (!arenaStack.empty()) return;
+    
+    releaseString(val, builder->getInt1(true));
+}
+
+// Frees a value only if the flag is set
+// free ignores null, so this doesn't need a branch
+void Compiler::freeIfOwned(Value *val, Value *owned) {
+    Value *null = ConstantPointerNull::get(Type::getInt8PtrTy(*context));
+    val = builder->CreateBitCast(val, Type::getInt8PtrTy(*context));
+    
+    Function *freeFunc = mod->getFunction("free");
+    builder->CreateCall(freeFunc, builder->CreateSelect(owned, val, null));
+}
+
+// Drops a reference to a string only if the flag is set
+void Compiler::releaseString(Value *val, Value *owned) {
+    Value *null = ConstantPointerNull::get(Type::getInt8PtrTy(*context));
+    
+    Function *releaseFunc = mod->getFunction("str_release");
+    builder->CreateCall(releaseFunc, builder->CreateSelect(owned, val, null));
+}
+
+// Checks whether a function could hold on to a string passed to it
+// An extern function can return it, store it through a structure parameter, or free
+// it. Orka functions only borrow their arguments, and retain anything they keep.
+bool Compiler::canCapture(Function *callee) {
+    if (callee->getName() == "free") return true;
+    if (!callee->isDeclaration()) return false;
+    if (callee->getReturnType()->isPointerTy()) return true;
+    
+    for (auto &arg : callee->args()) {
+        Type *type = arg.getType();
+        if (type->isStructTy()) return true;
+        if (type->isPointerTy() && type->getPointerElementType()->isStructTy()) return true;
+    }
+    
+    return false;
+}
+
+// Releases string temporaries passed to a call
+// Arguments a capturing callee took over were handed to it already
+void Compiler::releaseArguments(std::vector<Value *> args) {
+    for (auto arg : args) freeTemporary(arg);
+}
+
+// Frees everything the function still owns, and ends any open arenas
+void Compiler::compileScopeExit() {
+    compileArenaExit(0);
+    
+    for (auto owner : ownerFlags) {
+        Value *val = builder->CreateLoad(owner.first);
+        Value *owned = builder->CreateLoad(owner.second);
+        releaseString(val, owned);
+    }
+    
+    for (auto array : ownedArrays) {
+        Value *bufferPtr = builder->CreateStructGEP(array, 0);
+        Value *buffer = builder->CreateLoad(bufferPtr);
+        freeIfOwned(buffer, builder->getInt1(true));
+    }
+    
+    for (auto array : arrayFlags) {
+        Value *bufferPtr = builder->CreateStructGEP(array.first, 0);
+        Value *buffer = builder->CreateLoad(bufferPtr);
+        freeIfOwned(buffer, builder->CreateLoad(array.second));
+    }
+}
@@ -0,0 +1,144 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Orka compiler.
+// Orka is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <iostream>
+
+#include <LLVM/Compiler.hpp>
+
+//
+// printf and println calls with a literal format are broken up at compile time.
+// Each literal segment is written with its length already known, and each argument
+// goes straight to the runtime routine for its conversion, so nothing is parsed
+// at runtime. Anything else is left to the library functions.
+//
+// The arguments are all evaluated before anything is written, as they are for a
+// library call, so output from the arguments themselves comes out in the same place.
+//
+
+// Compiles a print call with a literal format, if it is one
+// Returns false if the call has to go to the library instead.
+bool Compiler::compilePrintCall(AstFuncCallStmt *fc) {
+    std::string name = fc->getName();
+    if (name != "printf" && name != "println") return false;
+    if (!mod->getFunction(name)) return false;
+    
+    std::vector<AstExpression *> exprs = fc->getExpressions();
+    if (exprs.size() == 0 || exprs.at(0)->getType() != AstType::StringL) return false;
+    std::string format = static_cast<AstString *>(exprs.at(0))->getValue();
+    
+    if (name == "println") {
+        if (exprs.size() != 1) return false;
+        compileWriteBytes(format + "\n");
+        return true;
+    }
+    
+    std::vector<std::string> segments;
+    std::string specs;
+    if (!parseFormat(format, segments, specs)) return false;
+    if (exprs.size() - 1 < specs.length()) return false;
+    
+    Function *printFunc = mod->getFunction(name);
+    std::vector<Value *> values;
+    bool matches = true;
+    for (size_t i = 1; i<exprs.size(); i++) {
+        AstExpression *argExpr = exprs.at(i);
+        Value *arg = compileValue(argExpr, argDataType(printFunc, i, argExpr));
+        values.push_back(arg);
+        
+        if (i > specs.length()) continue;
+        if (specs[i - 1] == 'f') matches = matches && arg->getType()->isFloatingPointTy();
+        else matches = matches && arg->getType()->isIntegerTy();
+    }
+    
+    // An argument that doesn't suit its conversion goes to the library, which knows
+    // what to do with it. Everything is already evaluated, so only the call is left.
+    if (!matches) {
+        std::vector<Value *> args;
+        args.push_back(compileValue(exprs.at(0)));
+        for (size_t i = 0; i<values.size(); i++) {
+            Value *val = values.at(i);
+            bool isUnsigned = isUnsignedExpression(exprs.at(i + 1));
+            if (args.size() < printFunc->arg_size()) {
+                val = castInt(val, printFunc->getArg(args.size())->getType(), isUnsigned);
+            } else if (printFunc->isVarArg()) {
+                val = promoteVarArg(val, isUnsigned);
+            }
+            args.push_back(val);
+        }
+        
+        builder->CreateCall(printFunc, args);
+        releaseArguments(args);
+        return true;
+    }
+    
+    for (size_t i = 0; i<specs.length(); i++) {
+        compileWriteBytes(segments.at(i));
+        
+        Value *arg = values.at(i);
+        bool isUnsigned = isUnsignedExpression(exprs.at(i + 1));
+        
+        if (specs[i] == 'f') {
+            Function *doubleFunc = mod->getFunction("format_double");
+            builder->CreateCall(doubleFunc, builder->CreateFPExt(arg, Type::getDoubleTy(*context)));
+        } else if (specs[i] == 'c') {
+            Function *charFunc = mod->getFunction("format_char");
+            builder->CreateCall(charFunc, castInt(arg, Type::getInt8Ty(*context), isUnsigned));
+        } else if (specs[i] == 'x') {
+            // Like the library's %x, this is the value as a 32-bit unsigned int
+            Function *hexFunc = mod->getFunction("format_hex");
+            arg = castInt(arg, Type::getInt32Ty(*context), isUnsigned);
+            builder->CreateCall(hexFunc, castInt(arg, Type::getInt64Ty(*context), true));
+        } else {
+            Function *intFunc = mod->getFunction("format_int");
+            builder->CreateCall(intFunc, castInt(arg, Type::getInt64Ty(*context), isUnsigned));
+        }
+    }
+    
+    compileWriteBytes(segments.back());
+    releaseArguments(values);
+    return true;
+}
+
+// Splits a format into the literal segments around each conversion
+// There is always one more segment than conversion. Returns false if the format
+// uses something only the library understands.
+bool Compiler::parseFormat(std::string format, std::vector<std::string> &segments, std::string &specs) {
+    std::string segment = "";
+    
+    for (size_t i = 0; i<format.length(); i++) {
+        if (format[i] != '%') {
+            segment += format[i];
+            continue;
+        }
+        
+        if (i + 1 == format.length()) return false;
+        char spec = format[i + 1];
+        if (spec != 'd' && spec != 'x' && spec != 'c' && spec != 'f') return false;
+        
+        segments.push_back(segment);
+        specs += spec;
+        segment = "";
+        ++i;
+    }
+    
+    segments.push_back(segment);
+    return true;
+}
+
+// Writes literal text, with its length known now
+// The text is a plain C string with no header, so it can go in a mergeable section
+// and share storage with identical text from other objects.
+void Compiler::compileWriteBytes(std::string text) {
+    if (text.length() == 0) return;
+    
+    Constant *str = textPool[text];
+    if (!str) {
+        str = builder->CreateGlobalStringPtr(text, "fmt");
+        textPool[text] = str;
+    }
+    
+    Function *writeFunc = mod->getFunction("write_bytes");
+    builder->CreateCall(writeFunc, { str, builder->getInt64(text.length()) });
+}
@@ -0,0 +1,338 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Orka compiler.
+// Orka is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <iostream>
+
+#include <LLVM/Compiler.hpp>
+
+//
+// Strings point at null-terminated characters, with a header holding the length,
+// capacity, and reference count right before them. The corelib (corelib/str.c)
+// builds, grows, and counts them at runtime; the compiler builds the literals.
+//
+// The compiler only emits reference counting where it can't avoid it. Temporaries
+// hand their reference over instead of being retained and released, parameters are
+// borrowed from the caller, and a returned variable moves its reference out.
+//
+
+// Builds a string literal
+// Literals get a reference count of 0, so the runtime never writes to or frees them
+Value *Compiler::compileStringLiteral(std::string value) {
+    auto pooled = stringPool.find(value);
+    if (pooled != stringPool.end()) return pooled->second;
+    
+    Constant *chars = ConstantDataArray::getString(*context, value, true);
+    Constant *len = builder->getInt64(value.length());
+    Constant *cap = builder->getInt64(0);
+    Constant *refs = builder->getInt64(0);
+    Constant *init = ConstantStruct::getAnon({ len, cap, refs, chars });
+    
+    GlobalVariable *literal = new GlobalVariable(*mod, init->getType(), true, GlobalValue::PrivateLinkage, init, "str");
+    literal->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    literal->setAlignment(Align(16));
+    
+    Constant *indices[] = { builder->getInt32(0), builder->getInt32(3), builder->getInt32(0) };
+    Constant *ptr = ConstantExpr::getInBoundsGetElementPtr(init->getType(), literal, indices);
+    stringPool[value] = ptr;
+    return ptr;
+}
+
+// Checks for an assignment that appends to the same string (s := s + x)
+// The appended value has to be a string or a character we can compile directly.
+bool Compiler::isStringAppend(AstVarAssign *va) {
+    AstExpression *expr = va->getExpressions().at(0);
+    if (expr->getType() != AstType::Add) return false;
+    
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    if (op->getLVal()->getType() != AstType::ID) return false;
+    if (static_cast<AstID *>(op->getLVal())->getValue() != va->getName()) return false;
+    
+    AstExpression *rval = op->getRVal();
+    switch (rval->getType()) {
+        case AstType::StringL:
+        case AstType::CharL: return true;
+        
+        case AstType::ID: {
+            DataType type = typeTable[static_cast<AstID *>(rval)->getValue()];
+            return type == DataType::String || type == DataType::Char || type == DataType::Byte;
+        }
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Appends to a string variable in place
+// If the variable's string is shared (or isn't its own), the runtime makes a copy
+// first. Either way the variable holds the only reference to the result.
+void Compiler::compileStringAppend(AstVarAssign *va) {
+    AllocaInst *ptr = symtable[va->getName()];
+    AllocaInst *flag = ownerFlags[ptr];
+    
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(va->getExpressions().at(0));
+    AstExpression *rval = op->getRVal();
+    
+    bool isChar = rval->getType() == AstType::CharL;
+    if (rval->getType() == AstType::ID) isChar = typeTable[static_cast<AstID *>(rval)->getValue()] != DataType::String;
+    
+    Function *callee = mod->getFunction(isChar ? "strappend_char" : "strappend_str");
+    if (!callee) std::cerr << "Error: Corelib function \"strappend\" not found." << std::endl;
+    
+    Value *str = builder->CreateLoad(ptr);
+    Value *val = compileValue(rval);
+    if (isChar) val = castInt(val, Type::getInt8Ty(*context), false);
+    Value *owned = builder->CreateLoad(flag);
+    Value *ownedArg = builder->CreateZExt(owned, Type::getInt32Ty(*context));
+    
+    Value *result = builder->CreateCall(callee, { str, val, ownedArg });
+    builder->CreateStore(result, ptr);
+    
+    // A string from outside the arena that grew in place stays on the heap,
+    // so the variable still owns it; a copy was made in the arena.
+    if (canOwn(ptr)) {
+        owned = builder->getInt1(true);
+    } else {
+        Function *arenaFunc = mod->getFunction("in_arena");
+        Value *onHeap = builder->CreateICmpEQ(builder->CreateCall(arenaFunc, result), builder->getInt32(0));
+        Value *kept = builder->CreateOr(builder->CreateICmpEQ(result, str), onHeap);
+        owned = builder->CreateAnd(owned, kept);
+    }
+    builder->CreateStore(owned, flag);
+}
+
+// Creates an inline string buffer in the entry block
+Value *Compiler::createStringBuffer() {
+    BasicBlock *entry = &currentFunc->getEntryBlock();
+    IRBuilder<> entryBuilder(entry, entry->begin());
+    
+    Type *bufferType = ArrayType::get(Type::getInt8Ty(*context), STR_BUFFER_SIZE);
+    AllocaInst *buffer = entryBuilder.CreateAlloca(bufferType);
+    buffer->setAlignment(Align(16));
+    return entryBuilder.CreateBitCast(buffer, Type::getInt8PtrTy(*context));
+}
+
+// Gets a reference to a string that can be kept anywhere (a structure, an array, a caller)
+// A temporary hands over its reference, and so does a variable being moved out of.
+// Anything else gets a new one. Inline strings are copied to the heap.
+Value *Compiler::retainString(AstExpression *expr, Value *val, bool move) {
+    if (val->getType() != Type::getInt8PtrTy(*context)) return val;
+    
+    Value *owned = builder->getInt1(false);
+    if (move || tempStrings.find(val) != tempStrings.end()) owned = takeOwnership(expr, val);
+    owned = builder->CreateZExt(owned, Type::getInt32Ty(*context));
+    
+    Function *takeFunc = mod->getFunction("str_take");
+    return builder->CreateCall(takeFunc, { val, owned });
+}
+
+// Checks whether a call returns a string with a reference for the caller
+// Orka functions do; extern functions don't know about the count, except the
+// runtime's conversions, which build a new string.
+bool Compiler::isOrkaStringCall(Function *callee) {
+    if (callee->getReturnType() != Type::getInt8PtrTy(*context)) return false;
+    if (callee->isDeclaration()) return callee->getName() == "dtostr";
+    return true;
+}
+
+// Makes a string variable safe to write to before an indexed write
+// A shared string (or a literal) is copied, and the variable moves to the copy.
+// Inside an arena, a variable from outside it can't own the copy.
+void Compiler::compileStringUnique(AllocaInst *ptr) {
+    AllocaInst *flag = ownerFlags[ptr];
+    
+    Value *str = builder->CreateLoad(ptr);
+    Value *owned = builder->CreateLoad(flag);
+    Value *ownedArg = builder->CreateZExt(owned, Type::getInt32Ty(*context));
+    
+    Function *uniqueFunc = mod->getFunction("str_unique");
+    Value *result = builder->CreateCall(uniqueFunc, { str, ownedArg });
+    builder->CreateStore(result, ptr);
+    
+    if (canOwn(ptr)) owned = builder->getInt1(true);
+    else owned = builder->CreateAnd(owned, builder->CreateICmpEQ(result, str));
+    builder->CreateStore(owned, flag);
+}
+
+// Checks for a chain of concatenations starting with a string (a + b + c ...)
+// A single concatenation is left to strcat_str and strcat_char.
+bool Compiler::isStringChain(AstExpression *expr) {
+    if (expr->getType() != AstType::Add) return false;
+    
+    AstExpression *first = static_cast<AstBinaryOp *>(expr)->getLVal();
+    if (first->getType() != AstType::Add) return false;
+    while (first->getType() == AstType::Add) first = static_cast<AstBinaryOp *>(first)->getLVal();
+    
+    switch (first->getType()) {
+        case AstType::StringL: return true;
+        case AstType::ID: return typeTable[static_cast<AstID *>(first)->getValue()] == DataType::String;
+        
+        case AstType::FuncCallExpr: {
+            Function *callee = mod->getFunction(static_cast<AstFuncCallExpr *>(first)->getName());
+            return callee && callee->getReturnType() == Type::getInt8PtrTy(*context);
+        }
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Flattens a concatenation chain into its pieces, left to right
+void Compiler::collectStringChain(AstExpression *expr, std::vector<AstExpression *> &pieces) {
+    if (expr->getType() == AstType::Add) {
+        AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+        collectStringChain(op->getLVal(), pieces);
+        pieces.push_back(op->getRVal());
+    } else {
+        pieces.push_back(expr);
+    }
+}
+
+// Builds a whole concatenation chain with one allocation
+// Every length is read once (literal lengths are constants), the result is made
+// at its final size, and each piece is copied straight into place.
+Value *Compiler::compileStringChain(AstExpression *expr) {
+    std::vector<AstExpression *> exprs;
+    collectStringChain(expr, exprs);
+    
+    std::vector<Value *> pieces;
+    std::vector<Value *> lengths;
+    Value *total = builder->getInt64(0);
+    
+    for (auto pieceExpr : exprs) {
+        Value *val = compileValue(pieceExpr);
+        Value *len;
+        
+        if (val->getType()->isPointerTy()) {
+            if (pieceExpr->getType() == AstType::StringL) {
+                len = builder->getInt64(static_cast<AstString *>(pieceExpr)->getValue().length());
+            } else {
+                len = compileStringLength(val);
+            }
+        } else {
+            val = castInt(val, Type::getInt8Ty(*context), isUnsignedExpression(pieceExpr));
+            len = builder->getInt64(1);
+        }
+        
+        pieces.push_back(val);
+        lengths.push_back(len);
+        total = builder->CreateAdd(total, len);
+    }
+    
+    Function *newFunc = mod->getFunction("str_new");
+    Value *buffer = createStringBuffer();
+    Value *result = builder->CreateCall(newFunc, { total, buffer });
+    
+    Value *offset = builder->getInt64(0);
+    for (size_t i = 0; i<pieces.size(); i++) {
+        Value *dest = builder->CreateGEP(Type::getInt8Ty(*context), result, offset);
+        if (pieces.at(i)->getType()->isPointerTy()) {
+            builder->CreateMemCpy(dest, MaybeAlign(1), pieces.at(i), MaybeAlign(1), lengths.at(i));
+        } else {
+            builder->CreateStore(pieces.at(i), dest);
+        }
+        offset = builder->CreateAdd(offset, lengths.at(i));
+    }
+    
+    for (auto piece : pieces) freeTemporary(piece);
+    tempStrings.insert(result);
+    return result;
+}
+
+// Reads the length of a string from its header
+Value *Compiler::compileStringLength(Value *str) {
+    Value *lenPtr = builder->CreateConstGEP1_64(Type::getInt8Ty(*context), str, -(int64_t)sizeof(int64_t) * 3);
+    lenPtr = builder->CreateBitCast(lenPtr, Type::getInt64PtrTy(*context));
+    return builder->CreateLoad(Type::getInt64Ty(*context), lenPtr);
+}
+
+// Builds a string equality test
+// The lengths are compared inline; only strings of the same length have their
+// characters compared, by mem_equal in the corelib.
+Value *Compiler::compileStringEquals(Value *lval, Value *rval) {
+    Value *len = compileStringLength(lval);
+    Value *sameLen = builder->CreateICmpEQ(len, compileStringLength(rval));
+    
+    BasicBlock *lenBlock = builder->GetInsertBlock();
+    BasicBlock *cmpBlock = BasicBlock::Create(*context, "str_eq" + std::to_string(blockCount), currentFunc);
+    BasicBlock *mergeBlock = BasicBlock::Create(*context, "str_eq_end" + std::to_string(blockCount), currentFunc);
+    ++blockCount;
+    
+    cmpBlock->moveAfter(lenBlock);
+    mergeBlock->moveAfter(cmpBlock);
+    builder->CreateCondBr(sameLen, cmpBlock, mergeBlock);
+    
+    builder->SetInsertPoint(cmpBlock);
+    Function *memEqual = mod->getFunction("mem_equal");
+    Value *result = builder->CreateCall(memEqual, { lval, rval, len });
+    Value *isEqual = builder->CreateICmpNE(result, builder->getInt32(0));
+    builder->CreateBr(mergeBlock);
+    
+    builder->SetInsertPoint(mergeBlock);
+    PHINode *phi = builder->CreatePHI(Type::getInt1Ty(*context), 2);
+    phi->addIncoming(builder->getInt1(false), lenBlock);
+    phi->addIncoming(isEqual, cmpBlock);
+    return phi;
+}
+
+// Builds an equality test against a literal
+// The length is checked against the literal's, and then the characters are compared
+// in 8-byte chunks against constants, with no calls. A short end is read as a chunk
+// overlapping the one before it, or in 4, 2 and 1-byte pieces. Long literals are left
+// to mem_equal.
+Value *Compiler::compileLiteralEquals(Value *str, std::string literal) {
+    if (literal.length() > INLINE_COMPARE_MAX) return compileStringEquals(str, compileStringLiteral(literal));
+    
+    Value *sameLen = builder->CreateICmpEQ(compileStringLength(str), builder->getInt64(literal.length()));
+    if (literal.empty()) return sameLen;
+    
+    BasicBlock *lenBlock = builder->GetInsertBlock();
+    BasicBlock *cmpBlock = BasicBlock::Create(*context, "str_eq" + std::to_string(blockCount), currentFunc);
+    BasicBlock *mergeBlock = BasicBlock::Create(*context, "str_eq_end" + std::to_string(blockCount), currentFunc);
+    ++blockCount;
+    
+    cmpBlock->moveAfter(lenBlock);
+    mergeBlock->moveAfter(cmpBlock);
+    builder->CreateCondBr(sameLen, cmpBlock, mergeBlock);
+    builder->SetInsertPoint(cmpBlock);
+    
+    // Each chunk is xor-ed with what it should be; any difference leaves a bit set
+    Value *diff = builder->getInt64(0);
+    size_t length = literal.length();
+    size_t offset = 0;
+    
+    while (offset < length) {
+        size_t width = 8;
+        if (length - offset < 8) {
+            if (length >= 8) offset = length - 8;
+            else if (length - offset >= 4) width = 4;
+            else if (length - offset >= 2) width = 2;
+            else width = 1;
+        }
+        
+        // Loads are little-endian, so the first character is the low byte
+        uint64_t expected = 0;
+        for (size_t i = 0; i<width; i++) expected |= (uint64_t)(uint8_t)literal[offset + i] << (8 * i);
+        
+        Type *chunkType = builder->getIntNTy(width * 8);
+        Value *ptr = builder->CreateConstGEP1_64(Type::getInt8Ty(*context), str, offset);
+        ptr = builder->CreateBitCast(ptr, chunkType->getPointerTo());
+        Value *chunk = builder->CreateAlignedLoad(chunkType, ptr, MaybeAlign(1));
+        
+        chunk = builder->CreateXor(chunk, ConstantInt::get(chunkType, expected));
+        diff = builder->CreateOr(diff, builder->CreateZExt(chunk, Type::getInt64Ty(*context)));
+        offset += width;
+    }
+    
+    Value *isEqual = builder->CreateICmpEQ(diff, builder->getInt64(0));
+    builder->CreateBr(mergeBlock);
+    
+    builder->SetInsertPoint(mergeBlock);
+    PHINode *phi = builder->CreatePHI(Type::getInt1Ty(*context), 2);
+    phi->addIncoming(builder->getInt1(false), lenBlock);
+    phi->addIncoming(isEqual, cmpBlock);
+    return phi;
+}
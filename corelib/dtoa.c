@@ -0,0 +1,533 @@
+#include <stdint.h>
+
+//
+// Shortest round-trip conversion of doubles to decimal
+//
+// This is Grisu3 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers"). The number and the halfway points to its neighbours
+// are scaled by a cached power of ten so the digits can be generated with 64-bit
+// integer math, and generation stops as soon as the digits are inside the
+// neighbours' bounds. For the few numbers where the rounding error in that scaling
+// leaves the answer in doubt, an exact big-integer method takes over, so the result
+// is always the shortest string that reads back as the same double (and the closest
+// one, if there are several).
+//
+
+typedef struct
+{
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_SIZE     52
+#define DP_EXPONENT_BIAS        (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_HIDDEN_BIT           ((uint64_t)1 << DP_SIGNIFICAND_SIZE)
+#define DP_SIGNIFICAND_MASK     (DP_HIDDEN_BIT - 1)
+#define DP_EXPONENT_MASK        0x7FF0000000000000ull
+
+// 10^k as a normalized 64-bit significand and binary exponent, for k = -348, -340, ..., 340
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+    0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+    0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+    0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+    0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+    0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+    0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+    0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+    0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+    0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+    0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+    0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+    0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+    0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+    0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+    0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+    0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+    0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+    0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+    0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+    0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+    0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+    0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+    0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+    0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+    0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+    0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+    0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+    0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t pow10_64[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+};
+
+static DiyFp diy_from_double(double value)
+{
+    union { double d; uint64_t u; } bits = { value };
+    int biased = (bits.u & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE;
+    uint64_t significand = bits.u & DP_SIGNIFICAND_MASK;
+    
+    DiyFp result;
+    if (biased != 0) {
+        result.f = significand + DP_HIDDEN_BIT;
+        result.e = biased - DP_EXPONENT_BIAS;
+    } else {
+        result.f = significand;
+        result.e = 1 - DP_EXPONENT_BIAS;
+    }
+    return result;
+}
+
+static DiyFp diy_normalize(DiyFp x)
+{
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+// Multiplies two numbers, keeping the rounded upper 64 bits of the product
+static DiyFp diy_multiply(DiyFp x, DiyFp y)
+{
+    unsigned __int128 product = (unsigned __int128)x.f * y.f;
+    uint64_t high = product >> 64;
+    uint64_t low = (uint64_t)product;
+    if (low & ((uint64_t)1 << 63)) ++high;
+    
+    DiyFp result = { high, x.e + y.e + 64 };
+    return result;
+}
+
+// Finds the halfway points between a number and its neighbours, on the same exponent
+static void normalized_boundaries(DiyFp v, DiyFp *minus, DiyFp *plus)
+{
+    DiyFp upper = { (v.f << 1) + 1, v.e - 1 };
+    upper = diy_normalize(upper);
+    
+    // The gap below a power of two is half the gap above it
+    DiyFp lower;
+    if (v.f == DP_HIDDEN_BIT) {
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
+    } else {
+        lower.f = (v.f << 1) - 1;
+        lower.e = v.e - 1;
+    }
+    
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+    
+    *minus = lower;
+    *plus = upper;
+}
+
+// Picks a cached power that brings the exponent into [-60, -32]
+// Returns it along with the decimal exponent it was scaled by.
+static DiyFp cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) ++ik;
+    
+    unsigned index = (ik >> 3) + 1;
+    *k = -(-348 + (int)index * 8);
+    
+    DiyFp result = { cached_powers_f[index], cached_powers_e[index] };
+    return result;
+}
+
+static int count_digits(uint32_t n)
+{
+    int count = 1;
+    while (count < 10 && n >= pow10_64[count]) ++count;
+    return count;
+}
+
+// Moves the last digit down while that brings the result closer to the real value
+// Returns 0 if the scaled numbers are too imprecise to be sure the digits are right.
+static int round_weed(char *buffer, int len, uint64_t too_high_w, uint64_t unsafe,
+                      uint64_t rest, uint64_t ten_kappa, uint64_t unit)
+{
+    uint64_t small = too_high_w - unit;
+    uint64_t big = too_high_w + unit;
+    
+    while (rest < small && unsafe - rest >= ten_kappa
+           && (rest + ten_kappa < small || small - rest >= rest + ten_kappa - small)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+    
+    // Another step could still be closer to the far end of the error range
+    if (rest < big && unsafe - rest >= ten_kappa
+        && (rest + ten_kappa < big || big - rest > rest + ten_kappa - big)) {
+        return 0;
+    }
+    
+    return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+// Generates digits of the upper bound until they are within the bounds
+// The bounds are widened by one unit of error; anything that might only fit in that
+// margin is reported as a failure.
+static int digit_gen(DiyFp low, DiyFp w, DiyFp high, char *buffer, int *len, int *kappa)
+{
+    uint64_t unit = 1;
+    uint64_t too_low = low.f - unit;
+    uint64_t too_high = high.f + unit;
+    uint64_t unsafe = too_high - too_low;
+    
+    DiyFp one = { (uint64_t)1 << -w.e, w.e };
+    uint32_t p1 = too_high >> -one.e;
+    uint64_t p2 = too_high & (one.f - 1);
+    *kappa = count_digits(p1);
+    *len = 0;
+    
+    // The integer part
+    while (*kappa > 0) {
+        uint32_t divisor = pow10_64[*kappa - 1];
+        buffer[(*len)++] = '0' + p1 / divisor;
+        p1 %= divisor;
+        --*kappa;
+        
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest < unsafe) {
+            return round_weed(buffer, *len, too_high - w.f, unsafe, rest,
+                              (uint64_t)divisor << -one.e, unit);
+        }
+    }
+    
+    // The fractional part
+    for (;;) {
+        p2 *= 10;
+        unit *= 10;
+        unsafe *= 10;
+        
+        buffer[(*len)++] = '0' + (char)(p2 >> -one.e);
+        p2 &= one.f - 1;
+        --*kappa;
+        
+        if (p2 < unsafe) {
+            return round_weed(buffer, *len, (too_high - w.f) * unit, unsafe, p2, one.f, unit);
+        }
+    }
+}
+
+//
+// The exact fallback
+//
+// When Grisu can't decide, the digits come from the exact fraction instead (Burger and
+// Dybvig's free-format algorithm). The value is r / s * 10^k, and m_plus / m_minus are
+// the distances to the halfway points, all as big integers. 1100 bits covers every
+// double; this is slow, but only a tiny fraction of numbers get here.
+//
+
+#define BIG_WORDS       40
+
+typedef struct
+{
+    uint32_t words[BIG_WORDS];
+    int size;
+} BigInt;
+
+static void big_set(BigInt *x, uint64_t value)
+{
+    x->size = 0;
+    while (value) {
+        x->words[x->size++] = (uint32_t)value;
+        value >>= 32;
+    }
+}
+
+static void big_mul_small(BigInt *x, uint32_t factor)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i<x->size; i++) {
+        uint64_t product = (uint64_t)x->words[i] * factor + carry;
+        x->words[i] = (uint32_t)product;
+        carry = product >> 32;
+    }
+    if (carry) x->words[x->size++] = (uint32_t)carry;
+}
+
+static void big_mul_pow10(BigInt *x, int exp)
+{
+    for (; exp >= 9; exp -= 9) big_mul_small(x, 1000000000);
+    if (exp > 0) big_mul_small(x, (uint32_t)pow10_64[exp]);
+}
+
+static void big_shift_left(BigInt *x, int shift)
+{
+    if (x->size == 0) return;
+    
+    int words = shift / 32;
+    int bits = shift % 32;
+    
+    x->words[x->size] = 0;
+    for (int i = x->size; i>=0; i--) {
+        uint32_t high = x->words[i] << bits;
+        uint32_t low = (bits && i > 0) ? x->words[i - 1] >> (32 - bits) : 0;
+        if (i + words < BIG_WORDS) x->words[i + words] = high | low;
+    }
+    for (int i = 0; i<words; i++) x->words[i] = 0;
+    
+    x->size += words + 1;
+    while (x->size > 0 && x->words[x->size - 1] == 0) --x->size;
+}
+
+static int big_compare(BigInt *x, BigInt *y)
+{
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    for (int i = x->size - 1; i>=0; i--) {
+        if (x->words[i] != y->words[i]) return x->words[i] < y->words[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// Compares x + y against z
+static int big_plus_compare(BigInt *x, BigInt *y, BigInt *z)
+{
+    BigInt sum;
+    uint64_t carry = 0;
+    int size = x->size > y->size ? x->size : y->size;
+    
+    for (int i = 0; i<size; i++) {
+        uint64_t a = i < x->size ? x->words[i] : 0;
+        uint64_t b = i < y->size ? y->words[i] : 0;
+        carry += a + b;
+        sum.words[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum.size = size;
+    if (carry) sum.words[sum.size++] = (uint32_t)carry;
+    
+    return big_compare(&sum, z);
+}
+
+// x -= y, with x >= y
+static void big_subtract(BigInt *x, BigInt *y)
+{
+    int64_t borrow = 0;
+    for (int i = 0; i<x->size; i++) {
+        int64_t diff = (int64_t)x->words[i] - (i < y->size ? y->words[i] : 0) - borrow;
+        borrow = diff < 0;
+        x->words[i] = (uint32_t)(diff + (borrow << 32));
+    }
+    while (x->size > 0 && x->words[x->size - 1] == 0) --x->size;
+}
+
+static int exact_shortest(double value, char *digits, int *exp10)
+{
+    DiyFp v = diy_from_double(value);
+    int even = (v.f & 1) == 0;
+    int narrow = v.f == DP_HIDDEN_BIT && v.e > 1 - DP_EXPONENT_BIAS;
+    
+    // Everything is doubled (or quadrupled below a power of two) to keep the halves whole
+    BigInt r, s, m_plus, m_minus;
+    big_set(&r, v.f << (narrow ? 2 : 1));
+    big_set(&m_plus, narrow ? 2 : 1);
+    big_set(&m_minus, 1);
+    big_set(&s, narrow ? 4 : 2);
+    
+    if (v.e >= 0) {
+        big_shift_left(&r, v.e);
+        big_shift_left(&m_plus, v.e);
+        big_shift_left(&m_minus, v.e);
+    } else {
+        big_shift_left(&s, -v.e);
+    }
+    
+    // Estimate the decimal exponent from the bit length; it may come out one too small
+    int bits = 64 - __builtin_clzll(v.f) + v.e;
+    int k = 0;
+    double estimate = (bits - 1) * 0.30102999566398114 - 1e-10;
+    k = (int)estimate;
+    if (estimate > k) ++k;
+    
+    if (k >= 0) {
+        big_mul_pow10(&s, k);
+    } else {
+        big_mul_pow10(&r, -k);
+        big_mul_pow10(&m_plus, -k);
+        big_mul_pow10(&m_minus, -k);
+    }
+    
+    int high = big_plus_compare(&r, &m_plus, &s);
+    if (even ? high >= 0 : high > 0) {
+        big_mul_small(&s, 10);
+        ++k;
+    }
+    
+    int len = 0;
+    for (;;) {
+        big_mul_small(&r, 10);
+        big_mul_small(&m_plus, 10);
+        big_mul_small(&m_minus, 10);
+        
+        int d = 0;
+        while (big_compare(&r, &s) >= 0) {
+            big_subtract(&r, &s);
+            ++d;
+        }
+        
+        int low_cmp = big_compare(&r, &m_minus);
+        int high_cmp = big_plus_compare(&r, &m_plus, &s);
+        int tc_low = even ? low_cmp <= 0 : low_cmp < 0;
+        int tc_high = even ? high_cmp >= 0 : high_cmp > 0;
+        
+        if (!tc_low && !tc_high) {
+            digits[len++] = '0' + d;
+            continue;
+        }
+        
+        // Both neighbours work: take the closer one
+        if (tc_low && tc_high) {
+            BigInt twice = r;
+            big_shift_left(&twice, 1);
+            if (big_compare(&twice, &s) >= 0) ++d;
+        } else if (tc_high) {
+            ++d;
+        }
+        
+        digits[len++] = '0' + d;
+        break;
+    }
+    
+    *exp10 = k - len;
+    return len;
+}
+
+// Writes the shortest digits that read back as value, which must be positive and finite
+// Returns the number of digits; the value is digits * 10^exp10. There are at most 17.
+int dtoa_shortest(double value, char *digits, int *exp10)
+{
+    DiyFp v = diy_from_double(value);
+    DiyFp minus, plus;
+    normalized_boundaries(v, &minus, &plus);
+    
+    int k;
+    DiyFp c_mk = cached_power(plus.e, &k);
+    DiyFp w = diy_multiply(diy_normalize(v), c_mk);
+    DiyFp wp = diy_multiply(plus, c_mk);
+    DiyFp wm = diy_multiply(minus, c_mk);
+    
+    int len, kappa;
+    if (!digit_gen(wm, w, wp, digits, &len, &kappa)) return exact_shortest(value, digits, exp10);
+    
+    *exp10 = k + kappa;
+    return len;
+}
+
+//
+// A fixed number of digits
+//
+// printf with a precision needs the exact value rounded at a given digit, not the
+// shortest digits rounded again (which would round twice). These come from the same
+// big-integer fraction, one digit at a time. The remainder decides the rounding, and
+// an exact tie goes to the even digit, as C's printf does.
+//
+
+// Generates count digits, or with fixed set, every digit up to count places after the
+// point. The value is 0.d1d2d3... * 10^point. Returns the number of digits, which may
+// be 0 if the value rounds to zero; the digits buffer needs room for count digits, plus
+// (with fixed) one for each power of ten above 1.
+static int exact_digits(double value, int count, int fixed, char *digits, int *point)
+{
+    *point = 1;
+    if (value == 0.0) return 0;
+    
+    DiyFp v = diy_from_double(value);
+    BigInt r, s;
+    big_set(&r, v.f);
+    big_set(&s, 1);
+    
+    if (v.e >= 0) big_shift_left(&r, v.e);
+    else big_shift_left(&s, -v.e);
+    
+    // Scale so that r / s is in [0.1, 1); the estimate may come out one too small
+    int bits = 64 - __builtin_clzll(v.f) + v.e;
+    double estimate = (bits - 1) * 0.30102999566398114 - 1e-10;
+    int k = (int)estimate;
+    if (estimate > k) ++k;
+    
+    if (k >= 0) big_mul_pow10(&s, k);
+    else big_mul_pow10(&r, -k);
+    
+    if (big_compare(&r, &s) >= 0) {
+        big_mul_small(&s, 10);
+        ++k;
+    }
+    
+    int len = fixed ? k + count : count;
+    
+    // Too small to reach the first digit kept
+    if (len < 0) {
+        *point = -count;
+        return 0;
+    }
+    
+    for (int i = 0; i<len; i++) {
+        big_mul_small(&r, 10);
+        
+        int d = 0;
+        while (big_compare(&r, &s) >= 0) {
+            big_subtract(&r, &s);
+            ++d;
+        }
+        digits[i] = '0' + d;
+    }
+    
+    // Round on what's left: more than half goes up, and so does half on an odd digit
+    big_shift_left(&r, 1);
+    int cmp = big_compare(&r, &s);
+    int odd = len > 0 && (digits[len - 1] - '0') % 2 == 1;
+    
+    *point = k;
+    if (cmp < 0 || (cmp == 0 && !odd)) {
+        if (len == 0) *point = -count;
+        return len;
+    }
+    
+    int end = len;
+    while (end > 0 && digits[end - 1] == '9') --end;
+    if (end == 0) {
+        digits[0] = '1';
+        for (int i = 1; i<=len; i++) digits[i] = '0';
+        *point = k + 1;
+        return fixed ? len + 1 : (len > 0 ? len : 1);
+    }
+    
+    ++digits[end - 1];
+    for (int i = end; i<len; i++) digits[i] = '0';
+    return len;
+}
+
+// Writes value, which must be positive and finite, rounded to count significant digits
+// Returns the number of digits; the value is 0.d1d2d3... * 10^point.
+int dtoa_precision(double value, int count, char *digits, int *point)
+{
+    if (count < 1) count = 1;
+    return exact_digits(value, count, 0, digits, point);
+}
+
+// Writes value, which must be positive and finite, rounded to frac places after the point
+// Returns the number of digits; the value is 0.d1d2d3... * 10^point.
+int dtoa_fixed(double value, int frac, char *digits, int *point)
+{
+    return exact_digits(value, frac, 1, digits, point);
+}
@@ -1,26 +1,246 @@
 #include <stdint.h>
 
-extern void syscall_str4(int code, int fd, const char *buf, int size);
+extern int64_t syscall4(int64_t code, int64_t arg1, int64_t arg2, int64_t arg3);
 
 extern int strlen(const char *line);
+extern uint8_t *malloc(int64_t size);
+extern void free(void *ptr);
+
+//
+// Output buffering
+//
+// Standard output and standard error each have a buffer. A terminal gets its output
+// a line at a time; anything else only when the buffer fills up. Writes too big for
+// the buffer go out together with what is already in it in a single writev. The
+// start code flushes everything before the program exits.
+//
+
+#define OUT_BUFFER_SIZE     4096
+
+#define SYS_WRITE           1
+#define SYS_IOCTL           16
+#define SYS_WRITEV          20
+#define TCGETS              0x5401
+
+#define MODE_UNKNOWN        0
+#define MODE_LINE           1
+#define MODE_FULL           2
+
+typedef struct
+{
+    char *data;
+    int64_t len;
+    int64_t cap;
+    int fd;
+    int mode;
+    int allocated;
+} OutBuffer;
+
+typedef struct
+{
+    const char *base;
+    int64_t len;
+} IoVec;
+
+static char stdout_data[OUT_BUFFER_SIZE];
+static char stderr_data[OUT_BUFFER_SIZE];
+
+static OutBuffer out_buffers[2] = {
+    { stdout_data, 0, OUT_BUFFER_SIZE, 1, MODE_UNKNOWN, 0 },
+    { stderr_data, 0, OUT_BUFFER_SIZE, 2, MODE_UNKNOWN, 0 },
+};
+
+static OutBuffer *get_out_buffer(int fd)
+{
+    if (fd == 1 || fd == 2) return &out_buffers[fd - 1];
+    return 0;
+}
+
+// Writes everything, going around again if the kernel takes only part of it
+static void write_all(int fd, const char *buf, int64_t len)
+{
+    while (len > 0) {
+        int64_t written = syscall4(SYS_WRITE, fd, (int64_t)buf, len);
+        if (written <= 0) return;
+        buf += written;
+        len -= written;
+    }
+}
+
+static void flush_buffer(OutBuffer *out)
+{
+    write_all(out->fd, out->data, out->len);
+    out->len = 0;
+}
+
+// A terminal answers the termios request; files and pipes don't
+static int is_tty(int fd)
+{
+    char termios[64];
+    return syscall4(SYS_IOCTL, fd, TCGETS, (int64_t)termios) == 0;
+}
+
+void write_fd(int fd, const char *buf, int64_t len)
+{
+    OutBuffer *out = get_out_buffer(fd);
+    if (!out) {
+        write_all(fd, buf, len);
+        return;
+    }
+    
+    if (out->mode == MODE_UNKNOWN) out->mode = is_tty(fd) ? MODE_LINE : MODE_FULL;
+    
+    if (out->len + len > out->cap) {
+        if (len < out->cap) {
+            flush_buffer(out);
+        } else {
+            IoVec vec[2] = { { out->data, out->len }, { buf, len } };
+            int64_t total = out->len + len;
+            int64_t written = syscall4(SYS_WRITEV, fd, (int64_t)vec, 2);
+            
+            // Finish a partial write the simple way
+            if (written > 0 && written < total) {
+                if (written < out->len) {
+                    write_all(fd, out->data + written, out->len - written);
+                    written = out->len;
+                }
+                write_all(fd, buf + (written - out->len), total - written);
+            }
+            
+            out->len = 0;
+            return;
+        }
+    }
+    
+    int newline = 0;
+    for (int64_t i = 0; i<len; i++) {
+        out->data[out->len + i] = buf[i];
+        if (buf[i] == '\n') newline = 1;
+    }
+    out->len += len;
+    
+    if (newline && out->mode == MODE_LINE) flush_buffer(out);
+}
+
+void flush()
+{
+    flush_buffer(&out_buffers[0]);
+    flush_buffer(&out_buffers[1]);
+}
+
+// Sets the size of the buffer for standard output (1) or standard error (2)
+// A size of 0 turns buffering off.
+void set_output_buffer(int fd, int64_t size)
+{
+    OutBuffer *out = get_out_buffer(fd);
+    if (!out) return;
+    
+    flush_buffer(out);
+    if (out->allocated) free(out->data);
+    
+    out->data = size > 0 ? (char *)malloc(size) : 0;
+    out->cap = size;
+    out->allocated = size > 0;
+}
 
 void println(const char *line)
 {
     int size = strlen(line);
     
-    syscall_str4(1, 1, line, size);
-    syscall_str4(1, 1, "\n", 1);
+    write_fd(1, line, size);
+    write_fd(1, "\n", 1);
 }
 
 // TODO: Move this elsewhere
 typedef struct
 {
     char *array;
-    int size;
+    int64_t size;
 } CharArray;
 
 void printCharArray(CharArray array)
 {
-    syscall_str4(1, 1, array.array, array.size);
+    write_fd(1, array.array, array.size);
 }
 
+
+//
+// Output pieces for printf and println calls the compiler breaks up ahead of time
+//
+void write_bytes(const char *buf, int64_t len)
+{
+    write_fd(1, buf, len);
+}
+
+void format_char(char c)
+{
+    write_bytes(&c, 1);
+}
+
+// Every two-digit number, so decimal conversion takes one division per two digits
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Writes the decimal digits of a number to buf (which needs room for 20)
+// Returns the number of digits.
+int format_u64(char *buf, uint64_t value)
+{
+    char digits[20];
+    int index = 20;
+    
+    while (value >= 100) {
+        int pair = (value % 100) * 2;
+        value /= 100;
+        digits[--index] = digit_pairs[pair + 1];
+        digits[--index] = digit_pairs[pair];
+    }
+    
+    if (value >= 10) {
+        digits[--index] = digit_pairs[value * 2 + 1];
+        digits[--index] = digit_pairs[value * 2];
+    } else {
+        digits[--index] = value + '0';
+    }
+    
+    int len = 20 - index;
+    for (int i = 0; i<len; i++) buf[i] = digits[index + i];
+    return len;
+}
+
+void format_int(int64_t num)
+{
+    char buf[21];
+    int len = 0;
+    
+    uint64_t value = num;
+    if (num < 0) {
+        buf[len++] = '-';
+        value = -value;
+    }
+    
+    len += format_u64(buf + len, value);
+    write_bytes(buf, len);
+}
+
+void format_hex(uint64_t num)
+{
+    char buf[16];
+    int index = 16;
+    
+    do {
+        int digit = num & 0xF;
+        buf[--index] = digit < 10 ? digit + '0' : digit - 10 + 'A';
+        num >>= 4;
+    } while (num != 0);
+    
+    write_bytes(buf + index, 16 - index);
+}
@@ -0,0 +1,470 @@
+#include <stdint.h>
+
+extern void *syscall6(int call, int64_t arg1, int64_t arg2, int64_t arg3, int64_t arg4, int64_t arg5);
+extern void *memset(void *dest, int c, uint64_t len);
+extern void *memcpy(void *dest, const void *src, uint64_t len);
+
+//
+// The memory allocator
+//
+// Small allocations are rounded up to a size class and carved out of 64 KiB slabs.
+// Each slab only holds blocks of one class, and slabs are cut from larger chunks
+// mapped from the kernel, so most allocations never make a syscall. Freed blocks go
+// on a per-class free list and are reused first. The runtime is single-threaded, so
+// these lists act as the thread cache.
+//
+// Anything bigger than the largest class gets its own mapping. Mappings of 2 MiB
+// and up are 2 MiB aligned and marked for transparent huge pages, and can be
+// pre-faulted with set_alloc_populate. realloc grows mappings with mremap, so the
+// pages are never copied.
+//
+// Every slab and large mapping starts on a 64 KiB boundary with a header, so free
+// can find the header from any pointer by masking off the low bits. Blocks are
+// 16-byte aligned, and blocks of 64 bytes or more are 64-byte aligned. free and
+// realloc also take pointers into the middle of a block (strings point past their
+// header), and realloc keeps the pointer at the same offset in the new block.
+//
+// calloc hands out zeroed memory. Blocks reused from a free list or a spare arena
+// chunk still hold old data, so small blocks are cleared by hand; large blocks are
+// always fresh mappings, which the kernel has already zeroed.
+//
+// While an arena is active, malloc bump-allocates from it instead. Arena chunks are
+// slab-sized and carry their own header, so free ignores arena blocks. Ending an
+// arena hands all of its chunks to a spare list at once; only blocks too big for a
+// chunk are unmapped one by one. realloc keeps a block where it was allocated: a
+// heap block stays on the heap, and an arena block stays in its own arena.
+//
+
+#define SLAB_SIZE       (64 * 1024)
+#define CHUNK_SIZE      (4 * 1024 * 1024)
+#define HUGE_SIZE       (2 * 1024 * 1024)
+#define PAGE_SIZE       4096
+#define HEADER_SIZE     64
+
+#define PROT_RW         3
+#define MAP_ANON        34
+#define MADV_HUGEPAGE   14
+#define MADV_POPULATE   23
+#define MREMAP_MAYMOVE  1
+#define MREMAP_FIXED    2
+
+#define SLAB_MAGIC      0x534C4142
+#define LARGE_MAGIC     0x4C415247
+#define ARENA_MAGIC     0x4152454E
+
+#define CLASS_COUNT     19
+#define MAX_SMALL       16384
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size_class;
+    uint64_t map_size;
+} BlockHeader;
+
+typedef struct FreeBlock
+{
+    struct FreeBlock *next;
+} FreeBlock;
+
+static const uint32_t class_sizes[CLASS_COUNT] = {
+    16, 32, 48, 64, 128, 192, 256, 384, 512, 768,
+    1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384
+};
+
+typedef struct ArenaChunk
+{
+    BlockHeader header;
+    struct ArenaChunk *next;
+} ArenaChunk;
+
+typedef struct Arena
+{
+    ArenaChunk *chunks;
+    ArenaChunk *large;
+    uint8_t *ptr;
+    uint8_t *end;
+    struct Arena *parent;
+} Arena;
+
+static FreeBlock *free_lists[CLASS_COUNT];
+static uint8_t *bump_ptr[CLASS_COUNT];
+static uint8_t *bump_end[CLASS_COUNT];
+
+static uint8_t *chunk_ptr = 0;
+static uint8_t *chunk_end = 0;
+
+static int populate_large = 0;
+
+static Arena *current_arena = 0;
+static ArenaChunk *spare_chunks = 0;
+
+static int is_error(int64_t ret)
+{
+    return ret < 0 && ret > -4096;
+}
+
+static uint64_t round_up(uint64_t size, uint64_t align)
+{
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Maps a region with the given alignment (at least a slab)
+// The kernel only promises page alignment, so we map extra and trim both ends
+static uint8_t *map_aligned(uint64_t size, uint64_t align)
+{
+    uint64_t total = size + align;
+    int64_t base = (int64_t)syscall6(9, 0, total, PROT_RW, MAP_ANON, -1);
+    if (is_error(base)) return 0;
+
+    uint64_t start = (uint64_t)base;
+    uint64_t aligned = round_up(start, align);
+    uint64_t end = aligned + size;
+
+    if (aligned > start) syscall6(11, start, aligned - start, 0, 0, 0);
+    if (start + total > end) syscall6(11, end, start + total - end, 0, 0, 0);
+    return (uint8_t *)aligned;
+}
+
+static int get_class(uint64_t size)
+{
+    for (int i = 0; i<CLASS_COUNT; i++) {
+        if (size <= class_sizes[i]) return i;
+    }
+    return -1;
+}
+
+static BlockHeader *get_header(void *ptr)
+{
+    return (BlockHeader *)((uint64_t)ptr & ~((uint64_t)SLAB_SIZE - 1));
+}
+
+// Sets up a new slab for a size class
+static int new_slab(int size_class)
+{
+    if (chunk_ptr == chunk_end) {
+        chunk_ptr = map_aligned(CHUNK_SIZE, SLAB_SIZE);
+        if (!chunk_ptr) return 0;
+        chunk_end = chunk_ptr + CHUNK_SIZE;
+    }
+
+    uint8_t *slab = chunk_ptr;
+    chunk_ptr += SLAB_SIZE;
+
+    BlockHeader *header = (BlockHeader *)slab;
+    header->magic = SLAB_MAGIC;
+    header->size_class = size_class;
+    header->map_size = SLAB_SIZE;
+
+    bump_ptr[size_class] = slab + HEADER_SIZE;
+    bump_end[size_class] = slab + SLAB_SIZE;
+    return 1;
+}
+
+// Turns on pre-faulting for huge allocations
+// This trades allocation time for no page faults on first touch
+void set_alloc_populate(int populate)
+{
+    populate_large = populate;
+}
+
+// Rounds a large allocation (with its header) up to its mapping size
+static uint64_t large_map_size(uint64_t size)
+{
+    uint64_t map_size = round_up(size + HEADER_SIZE, PAGE_SIZE);
+    if (map_size >= HUGE_SIZE) map_size = round_up(map_size, HUGE_SIZE);
+    return map_size;
+}
+
+// Asks for huge pages on a large mapping, and pre-faults it if requested
+// Kernels without MADV_POPULATE_WRITE get the pages touched by hand
+static void advise_large(uint8_t *region, uint64_t start, uint64_t map_size)
+{
+    if (map_size < HUGE_SIZE) return;
+    syscall6(28, (int64_t)region, map_size, MADV_HUGEPAGE, 0, 0);
+
+    if (!populate_large || start >= map_size) return;
+    int64_t ret = (int64_t)syscall6(28, (int64_t)region + start, map_size - start, MADV_POPULATE, 0, 0);
+    if (is_error(ret)) {
+        for (uint64_t i = start; i<map_size; i += PAGE_SIZE) region[i] = 0;
+    }
+}
+
+static uint8_t *malloc_large(uint64_t size)
+{
+    uint64_t map_size = large_map_size(size);
+    uint64_t align = map_size >= HUGE_SIZE ? HUGE_SIZE : SLAB_SIZE;
+    uint8_t *region = map_aligned(map_size, align);
+    if (!region) return 0;
+    advise_large(region, 0, map_size);
+
+    BlockHeader *header = (BlockHeader *)region;
+    header->magic = LARGE_MAGIC;
+    header->size_class = 0;
+    header->map_size = map_size;
+    return region + HEADER_SIZE;
+}
+
+// Gets a chunk for an arena, reusing one from an old arena if we can
+static ArenaChunk *new_arena_chunk()
+{
+    ArenaChunk *chunk = spare_chunks;
+    if (chunk) {
+        spare_chunks = chunk->next;
+    } else {
+        chunk = (ArenaChunk *)map_aligned(SLAB_SIZE, SLAB_SIZE);
+        if (!chunk) return 0;
+        chunk->header.magic = ARENA_MAGIC;
+        chunk->header.size_class = 0;
+        chunk->header.map_size = SLAB_SIZE;
+    }
+
+    chunk->next = 0;
+    return chunk;
+}
+
+// Starts a new arena
+// The arena lives at the start of its first chunk. Arenas nest, and all allocations
+// go to the innermost one until it ends.
+void *arena_begin()
+{
+    ArenaChunk *chunk = new_arena_chunk();
+    if (!chunk) return 0;
+
+    Arena *arena = (Arena *)((uint8_t *)chunk + HEADER_SIZE);
+    arena->chunks = chunk;
+    arena->large = 0;
+    arena->ptr = (uint8_t *)arena + round_up(sizeof(Arena), 16);
+    arena->end = (uint8_t *)chunk + SLAB_SIZE;
+    arena->parent = current_arena;
+
+    current_arena = arena;
+    return arena;
+}
+
+// Releases everything allocated in an arena
+// The first chunk is the last one in the list, so the whole list moves to the spares
+// without walking it.
+void arena_end(void *ptr)
+{
+    Arena *arena = (Arena *)ptr;
+    if (!arena) return;
+    current_arena = arena->parent;
+
+    ArenaChunk *large = arena->large;
+    while (large) {
+        ArenaChunk *next = large->next;
+        syscall6(11, (int64_t)large, large->header.map_size, 0, 0, 0);
+        large = next;
+    }
+
+    ArenaChunk *first = (ArenaChunk *)get_header(arena);
+    first->next = spare_chunks;
+    spare_chunks = arena->chunks;
+}
+
+static uint8_t *arena_alloc(Arena *arena, uint64_t size)
+{
+    size = round_up(size, 16);
+
+    // Too big for a chunk, so it gets its own mapping
+    if (size > SLAB_SIZE - HEADER_SIZE) {
+        uint64_t map_size = large_map_size(size);
+        ArenaChunk *chunk = (ArenaChunk *)map_aligned(map_size, SLAB_SIZE);
+        if (!chunk) return 0;
+
+        chunk->header.magic = ARENA_MAGIC;
+        chunk->header.size_class = 0;
+        chunk->header.map_size = map_size;
+        chunk->next = arena->large;
+        arena->large = chunk;
+        return (uint8_t *)chunk + HEADER_SIZE;
+    }
+
+    if (arena->ptr + size > arena->end) {
+        ArenaChunk *chunk = new_arena_chunk();
+        if (!chunk) return 0;
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->ptr = (uint8_t *)chunk + HEADER_SIZE;
+        arena->end = (uint8_t *)chunk + SLAB_SIZE;
+    }
+
+    uint8_t *block = arena->ptr;
+    arena->ptr += size;
+    return block;
+}
+
+// Finds the arena a block belongs to
+// Only the active arena and the ones it is nested in can still hold live blocks.
+static Arena *find_arena(BlockHeader *header)
+{
+    for (Arena *arena = current_arena; arena; arena = arena->parent) {
+        for (ArenaChunk *chunk = arena->chunks; chunk; chunk = chunk->next) {
+            if (&chunk->header == header) return arena;
+        }
+        for (ArenaChunk *chunk = arena->large; chunk; chunk = chunk->next) {
+            if (&chunk->header == header) return arena;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if a block is arena memory
+int in_arena(void *ptr)
+{
+    return get_header(ptr)->magic == ARENA_MAGIC;
+}
+
+// Allocates from the heap, even while an arena is active
+static uint8_t *heap_alloc(int64_t size)
+{
+    if (size > MAX_SMALL) return malloc_large(size);
+
+    int size_class = get_class(size);
+
+    FreeBlock *block = free_lists[size_class];
+    if (block) {
+        free_lists[size_class] = block->next;
+        return (uint8_t *)block;
+    }
+
+    uint32_t block_size = class_sizes[size_class];
+    if (bump_ptr[size_class] + block_size > bump_end[size_class]) {
+        if (!new_slab(size_class)) return 0;
+    }
+
+    uint8_t *ptr = bump_ptr[size_class];
+    bump_ptr[size_class] += block_size;
+    return ptr;
+}
+
+uint8_t *malloc(int64_t size)
+{
+    if (size <= 0) size = 1;
+    if (current_arena) return arena_alloc(current_arena, size);
+    return heap_alloc(size);
+}
+
+uint8_t *calloc(int64_t count, int64_t size)
+{
+    int64_t total = count * size;
+    if (total <= 0) total = 1;
+
+    uint8_t *ptr;
+    if (current_arena) {
+        ptr = arena_alloc(current_arena, total);
+        if (total > SLAB_SIZE - HEADER_SIZE) return ptr;
+    } else {
+        if (total > MAX_SMALL) return malloc_large(total);
+        ptr = heap_alloc(total);
+    }
+
+    if (ptr) memset(ptr, 0, total);
+    return ptr;
+}
+
+// Finds the start of the block a pointer points into
+static uint8_t *block_start(BlockHeader *header, void *ptr)
+{
+    uint8_t *first = (uint8_t *)header + HEADER_SIZE;
+    if (header->magic != SLAB_MAGIC) return first;
+
+    uint64_t size = class_sizes[header->size_class];
+    return first + ((uint8_t *)ptr - first) / size * size;
+}
+
+void free(void *ptr)
+{
+    if (!ptr) return;
+
+    BlockHeader *header = get_header(ptr);
+    if (header->magic == LARGE_MAGIC) {
+        syscall6(11, (int64_t)header, header->map_size, 0, 0, 0);
+    } else if (header->magic == SLAB_MAGIC) {
+        FreeBlock *block = (FreeBlock *)block_start(header, ptr);
+        block->next = free_lists[header->size_class];
+        free_lists[header->size_class] = block;
+    }
+
+    // Arena blocks are released with their arena
+}
+
+// Returns how many bytes a block can hold
+static uint64_t block_capacity(void *ptr)
+{
+    BlockHeader *header = get_header(ptr);
+    if (header->magic == LARGE_MAGIC) return header->map_size - HEADER_SIZE;
+    return class_sizes[header->size_class];
+}
+
+// Grows a large mapping without copying
+// The mapping is extended in place if the address space after it is free. Otherwise
+// the pages are moved into a fresh aligned reservation, which keeps the header findable.
+static uint8_t *realloc_large(BlockHeader *header, uint64_t size)
+{
+    uint64_t old_size = header->map_size;
+    uint64_t map_size = large_map_size(size);
+
+    int64_t ret = (int64_t)syscall6(25, (int64_t)header, old_size, map_size, 0, 0);
+    if (is_error(ret)) {
+        uint64_t align = map_size >= HUGE_SIZE ? HUGE_SIZE : SLAB_SIZE;
+        uint8_t *target = map_aligned(map_size, align);
+        if (!target) return 0;
+
+        ret = (int64_t)syscall6(25, (int64_t)header, old_size, map_size, MREMAP_MAYMOVE | MREMAP_FIXED, (int64_t)target);
+        if (is_error(ret)) {
+            syscall6(11, (int64_t)target, map_size, 0, 0, 0);
+            return 0;
+        }
+    }
+
+    uint8_t *region = (uint8_t *)ret;
+    advise_large(region, old_size, map_size);
+
+    header = (BlockHeader *)region;
+    header->map_size = map_size;
+    return region + HEADER_SIZE;
+}
+
+uint8_t *realloc(void *ptr, int64_t size)
+{
+    if (!ptr) return malloc(size);
+
+    if (size <= 0) size = 1;
+    BlockHeader *header = get_header(ptr);
+
+    // Arena blocks don't know their size, but they can't run past their chunk
+    if (header->magic == ARENA_MAGIC) {
+        Arena *arena = find_arena(header);
+        uint8_t *new_ptr = arena ? arena_alloc(arena, size) : heap_alloc(size);
+        if (!new_ptr) return 0;
+
+        uint8_t *src = (uint8_t *)ptr;
+        uint64_t limit = (uint8_t *)header + header->map_size - src;
+        if (limit > (uint64_t)size) limit = size;
+        memcpy(new_ptr, src, limit);
+        return new_ptr;
+    }
+
+    uint8_t *src = block_start(header, ptr);
+    uint64_t offset = (uint8_t *)ptr - src;
+    size += offset;
+
+    uint64_t capacity = block_capacity(src);
+    if ((uint64_t)size <= capacity) return (uint8_t *)ptr;
+
+    if (header->magic == LARGE_MAGIC) {
+        uint8_t *new_ptr = realloc_large(header, size);
+        if (new_ptr) return new_ptr + offset;
+    }
+
+    uint8_t *new_ptr = heap_alloc(size);
+    if (!new_ptr) return 0;
+
+    memcpy(new_ptr, src, capacity);
+
+    free(src);
+    return new_ptr + offset;
+}
@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+//
+// Memory primitives
+//
+// Copying, filling, comparing and searching memory, which is what string operations
+// spend their time on. Each works 16 bytes at a time with SSE2, which every x86-64
+// CPU has, or 32 at a time with AVX2 where the CPU supports it. The CPU is checked
+// once, on the first call that could use AVX2.
+//
+// Ends that don't fill a whole block are done with one more load that overlaps the
+// previous one, so nothing is ever read past the end of the memory.
+//
+
+typedef uint64_t __attribute__((aligned(1), may_alias)) unaligned_u64;
+
+// 0 = not checked yet, 1 = SSE2, 2 = AVX2
+static int simd_level = 0;
+
+static int detect_simd_level()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 1;
+
+    // AVX needs the OS to save the upper halves of the registers
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return 1;
+    unsigned int xcr0_low, xcr0_high;
+    __asm__ ("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0_low & 6) != 6) return 1;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return 1;
+    return (ebx & bit_AVX2) ? 2 : 1;
+}
+
+static int has_avx2()
+{
+    if (!simd_level) simd_level = detect_simd_level();
+    return simd_level == 2;
+}
+
+//
+// Copying and filling
+//
+
+__attribute__((target("avx2")))
+static void copy_avx2(char *dest, const char *src, uint64_t len)
+{
+    uint64_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dest + i), block);
+    }
+
+    if (i < len) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(src + len - 32));
+        _mm256_storeu_si256((__m256i *)(dest + len - 32), block);
+    }
+}
+
+void *memcpy(void *dest, const void *src, uint64_t len)
+{
+    char *d = (char *)dest;
+    const char *s = (const char *)src;
+
+    if (len < 16) {
+        if (len >= 8) {
+            uint64_t first = *(const unaligned_u64 *)s;
+            uint64_t last = *(const unaligned_u64 *)(s + len - 8);
+            *(unaligned_u64 *)d = first;
+            *(unaligned_u64 *)(d + len - 8) = last;
+        } else {
+            for (uint64_t i = 0; i<len; i++) d[i] = s[i];
+        }
+        return dest;
+    }
+
+    if (len >= 32 && has_avx2()) {
+        copy_avx2(d, s, len);
+        return dest;
+    }
+
+    uint64_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+        _mm_storeu_si128((__m128i *)(d + i), block);
+    }
+
+    if (i < len) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(s + len - 16));
+        _mm_storeu_si128((__m128i *)(d + len - 16), block);
+    }
+    return dest;
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(char *dest, char c, uint64_t len)
+{
+    __m256i block = _mm256_set1_epi8(c);
+    uint64_t i = 0;
+    for (; i + 32 <= len; i += 32) _mm256_storeu_si256((__m256i *)(dest + i), block);
+    if (i < len) _mm256_storeu_si256((__m256i *)(dest + len - 32), block);
+}
+
+void *memset(void *dest, int c, uint64_t len)
+{
+    char *d = (char *)dest;
+
+    if (len < 16) {
+        for (uint64_t i = 0; i<len; i++) d[i] = (char)c;
+        return dest;
+    }
+
+    if (len >= 32 && has_avx2()) {
+        fill_avx2(d, (char)c, len);
+        return dest;
+    }
+
+    __m128i block = _mm_set1_epi8((char)c);
+    uint64_t i = 0;
+    for (; i + 16 <= len; i += 16) _mm_storeu_si128((__m128i *)(d + i), block);
+    if (i < len) _mm_storeu_si128((__m128i *)(d + len - 16), block);
+    return dest;
+}
+
+//
+// Comparing
+//
+
+__attribute__((target("avx2")))
+static int equal_avx2(const char *a, const char *b, uint64_t len)
+{
+    uint64_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu) return 0;
+    }
+
+    if (i < len) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + len - 32));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + len - 32));
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu) return 0;
+    }
+    return 1;
+}
+
+// Returns 1 if the two blocks of memory hold the same bytes
+int mem_equal(const void *p1, const void *p2, uint64_t len)
+{
+    const char *a = (const char *)p1;
+    const char *b = (const char *)p2;
+
+    if (len < 16) {
+        if (len >= 8) {
+            return *(const unaligned_u64 *)a == *(const unaligned_u64 *)b
+                && *(const unaligned_u64 *)(a + len - 8) == *(const unaligned_u64 *)(b + len - 8);
+        }
+        for (uint64_t i = 0; i<len; i++) {
+            if (a[i] != b[i]) return 0;
+        }
+        return 1;
+    }
+
+    if (len >= 32 && has_avx2()) return equal_avx2(a, b, len);
+
+    uint64_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) return 0;
+    }
+
+    if (i < len) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + len - 16));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + len - 16));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) return 0;
+    }
+    return 1;
+}
+
+//
+// Searching
+//
+
+__attribute__((target("avx2")))
+static int64_t find_byte_avx2(const char *p, char c, uint64_t len)
+{
+    __m256i needle = _mm256_set1_epi8(c);
+    uint64_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    if (i < len) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + len - 32));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask) return len - 32 + __builtin_ctz(mask);
+    }
+    return -1;
+}
+
+// Finds the first c in the memory
+// Returns its index, or -1 if it isn't there.
+int64_t mem_find_byte(const void *ptr, char c, uint64_t len)
+{
+    const char *p = (const char *)ptr;
+
+    if (len < 16) {
+        for (uint64_t i = 0; i<len; i++) {
+            if (p[i] == c) return i;
+        }
+        return -1;
+    }
+
+    if (len >= 32 && has_avx2()) return find_byte_avx2(p, c, len);
+
+    __m128i needle = _mm_set1_epi8(c);
+    uint64_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    if (i < len) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + len - 16));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) return len - 16 + __builtin_ctz(mask);
+    }
+    return -1;
+}
+
+// Checks each candidate position whose first and last bytes match
+static int64_t check_candidates(const char *hay, uint64_t pos, uint32_t mask,
+                                const char *needle, uint64_t nlen)
+{
+    while (mask) {
+        int bit = __builtin_ctz(mask);
+        if (mem_equal(hay + pos + bit + 1, needle + 1, nlen - 2)) return pos + bit;
+        mask &= mask - 1;
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static uint64_t find_avx2(const char *hay, uint64_t hlen, const char *needle, uint64_t nlen, int64_t *found)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+
+    uint64_t i = 0;
+    for (; i + nlen + 31 <= hlen; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *)(hay + i + nlen - 1));
+        __m256i both = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                                        _mm256_cmpeq_epi8(last, blockLast));
+
+        *found = check_candidates(hay, i, _mm256_movemask_epi8(both), needle, nlen);
+        if (*found >= 0) return i;
+    }
+    return i;
+}
+
+// Finds the first copy of needle in hay
+// Returns its index, or -1 if it isn't there. Blocks of positions are filtered by
+// their first and last bytes at once, and only the positions where both match are
+// compared in full.
+int64_t mem_find(const char *hay, uint64_t hlen, const char *needle, uint64_t nlen)
+{
+    if (nlen == 0) return 0;
+    if (nlen > hlen) return -1;
+    if (nlen == 1) return mem_find_byte(hay, needle[0], hlen);
+
+    int64_t found = -1;
+    uint64_t i = 0;
+    if (has_avx2()) {
+        i = find_avx2(hay, hlen, needle, nlen, &found);
+        if (found >= 0) return found;
+    }
+
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+
+    for (; i + nlen + 15 <= hlen; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1));
+        __m128i both = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast));
+
+        found = check_candidates(hay, i, _mm_movemask_epi8(both), needle, nlen);
+        if (found >= 0) return found;
+    }
+
+    // The last few positions, one at a time
+    for (; i + nlen <= hlen; i++) {
+        if (hay[i] == needle[0] && mem_equal(hay + i + 1, needle + 1, nlen - 1)) return i;
+    }
+    return -1;
+}
+
+// Scans the length of a null-terminated string
+// The loads are aligned, so they never cross into a page past the terminator.
+uint64_t mem_cstrlen(const char *str)
+{
+    const char *block = (const char *)((uintptr_t)str & ~(uintptr_t)15);
+    __m128i zero = _mm_setzero_si128();
+
+    // Bytes before the start of the string don't count
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)block), zero));
+    mask &= 0xFFFF << (str - block);
+
+    while (!mask) {
+        block += 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)block), zero));
+    }
+
+    return block + __builtin_ctz(mask) - str;
+}
@@ -1,54 +1,284 @@
 #include <stdint.h>
 
 uint8_t *malloc(int64_t size);
+uint8_t *realloc(void *ptr, int64_t size);
+void free(void *ptr);
+
+void *memcpy(void *dest, const void *src, uint64_t len);
+int mem_equal(const void *p1, const void *p2, uint64_t len);
+int64_t mem_find_byte(const void *ptr, char c, uint64_t len);
+int64_t mem_find(const char *hay, uint64_t hlen, const char *needle, uint64_t nlen);
+uint64_t mem_cstrlen(const char *str);
+
+//
+// Strings
+//
+// A string points at null-terminated characters, so it can be handed to C as-is.
+// The 24 bytes before the characters hold the length, the capacity, and a reference
+// count. Strings built at runtime are allocated with their header and start with one
+// reference; the last release frees them. They grow by doubling when appended to,
+// and are written in place only while there is a single reference to them.
+//
+// Literals are built by the compiler with the same header and a count of 0, which
+// marks them read-only and never freed.
+//
+// Short strings don't need the allocator at all. The compiler gives each string
+// variable and each concatenation a small inline buffer (header and characters)
+// on the stack, and results of up to SSO_MAX characters are built there. Inline
+// strings have a count of -1. They aren't counted, and are copied when they have
+// to outlive their buffer.
+//
+
+#define SSO_MAX     22
+
+typedef struct
+{
+    int64_t len;
+    int64_t cap;
+    int64_t refs;
+} StrHeader;
+
+static StrHeader *get_str_header(const char *str)
+{
+    return (StrHeader *)str - 1;
+}
+
+// Allocates an empty string with room for cap characters
+static char *str_alloc(int64_t cap)
+{
+    StrHeader *header = (StrHeader *)malloc(sizeof(StrHeader) + cap + 1);
+    header->len = 0;
+    header->cap = cap;
+    header->refs = 1;
+    
+    char *str = (char *)(header + 1);
+    str[0] = '\0';
+    return str;
+}
+
+// Makes an empty string for a result of the given length
+// It goes in the inline buffer if there is one and the result fits
+static char *str_result(char *buf, int64_t len)
+{
+    if (!buf || len > SSO_MAX) return str_alloc(len);
+    
+    StrHeader *header = (StrHeader *)buf;
+    header->len = 0;
+    header->cap = 0;
+    header->refs = -1;
+    return (char *)(header + 1);
+}
+
+// Copies a string, into the buffer if there is one and it fits
+static char *str_copy(const char *str, char *buf)
+{
+    int64_t len = get_str_header(str)->len;
+    char *new_str = str_result(buf, len);
+    memcpy(new_str, str, len + 1);
+    get_str_header(new_str)->len = len;
+    return new_str;
+}
 
 int strlen(const char *line)
 {
-    int index = 0;
-    char c = line[index];
-    while (c) {
-        ++index;
-        c = line[index];
-    }
-    return index;
+    return get_str_header(line)->len;
+}
+
+// Scans the length of a plain C string
+int cstrlen(const char *line)
+{
+    return mem_cstrlen(line);
+}
+
+// Copies a plain C string into a string
+char *str_from_cstr(const char *line)
+{
+    int64_t len = cstrlen(line);
+    char *str = str_alloc(len);
+    memcpy(str, line, len + 1);
+    get_str_header(str)->len = len;
+    return str;
+}
+
+// Turns the program arguments into strings, in place
+// The kernel hands them over as plain C strings, which have no header.
+void str_init_args(char **argv, int64_t argc)
+{
+    for (int64_t i = 0; i<argc; i++) argv[i] = str_from_cstr(argv[i]);
 }
 
 int stringcmp(const char *str1, const char *str2)
 {
-    int length = strlen(str1);
-    if (length != strlen(str2)) return 0;
-    
-    for (int i = 0; i<length; i++) {
-        if (str1[i] != str2[i]) return 0;
+    int64_t length = get_str_header(str1)->len;
+    if (length != get_str_header(str2)->len) return 0;
+    return mem_equal(str1, str2, length);
+}
+
+// Finds the first copy of sub in a string
+// Returns its index, or -1 if it isn't there.
+int strfind(const char *str, const char *sub)
+{
+    return mem_find(str, get_str_header(str)->len, sub, get_str_header(sub)->len);
+}
+
+int strfind_char(const char *str, char c)
+{
+    return mem_find_byte(str, c, get_str_header(str)->len);
+}
+
+// FNV-1a hash, perturbed by a seed
+// The compiler picks the seed for string match statements, so this must stay
+// in sync with hashString in compiler/LLVM/Flow.cpp
+unsigned int strhash(const char *str, unsigned int seed)
+{
+    unsigned int hash = 2166136261u ^ seed;
+    for (int i = 0; str[i]; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
     }
     
-    return 1;
+    // Mix the high bits down, since the compiler only uses the low ones
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
 }
 
-char *strcat_char(const char *str, char c)
+char *strcat_char(const char *str, char c, char *buf)
 {
-    int len = strlen(str);
-    char *new_str = malloc(len + 1);
-    for (int i = 0; i<len; i++) new_str[i] = str[i];
+    int64_t len = get_str_header(str)->len;
+    char *new_str = str_result(buf, len + 1);
+    memcpy(new_str, str, len);
     new_str[len] = c;
     new_str[len+1] = '\0';
+    get_str_header(new_str)->len = len + 1;
+    return new_str;
+}
+
+char *strcat_str(const char *str, const char *str2, char *buf)
+{
+    int64_t len1 = get_str_header(str)->len;
+    int64_t len2 = get_str_header(str2)->len;
+    
+    char *new_str = str_result(buf, len1 + len2);
+    memcpy(new_str, str, len1);
+    memcpy(new_str + len1, str2, len2 + 1);
+    get_str_header(new_str)->len = len1 + len2;
     return new_str;
 }
 
-char *strcat_str(const char *str, const char *str2)
+// Makes a string of the given length for the compiler to fill in
+// It goes in the inline buffer if it fits there.
+char *str_new(int64_t len, char *buf)
+{
+    char *str = str_result(buf, len);
+    get_str_header(str)->len = len;
+    str[len] = '\0';
+    return str;
+}
+
+void str_release(char *str)
 {
-    int len1 = strlen(str);
-    int len2 = strlen(str2);
+    if (!str) return;
+    StrHeader *header = get_str_header(str);
+    if (header->refs <= 0) return;
     
-    char *new_str = malloc(len1 + len2 + 1);
-    int i;
-    for (i = 0; i<len1; i++) new_str[i] = str[i];
-    int index = i;
-    for (i = 0; i<len2; i++) {
-        new_str[index] = str2[i];
-        ++index;
+    --header->refs;
+    if (header->refs == 0) free(header);
+}
+
+// Stores a string into a variable
+// An inline string from another buffer is copied into the variable's own. The variable
+// keeps the reference it was handed (owned), or else takes a new one.
+char *str_store(char *slot, char *str, int owned)
+{
+    if (!str) return str;
+    StrHeader *header = get_str_header(str);
+    
+    if (header->refs < 0) {
+        if (str == slot + sizeof(StrHeader)) return str;
+        return str_copy(str, slot);
     }
     
-    new_str[index] = '\0';
+    if (!owned && header->refs > 0) ++header->refs;
+    return str;
+}
+
+// Gets a reference to a string that can be kept anywhere
+// Inline strings are copied to the heap, so they can outlive their buffer.
+char *str_take(char *str, int owned)
+{
+    if (!str) return str;
+    StrHeader *header = get_str_header(str);
+    
+    if (header->refs < 0) return str_copy(str, 0);
+    if (!owned && header->refs > 0) ++header->refs;
+    return str;
+}
+
+// Makes a string safe to write to
+// A string we hold the only reference to (or that sits in our own inline buffer) is
+// written in place. Anything else is copied, and our reference moves to the copy.
+char *str_unique(char *str, int owned)
+{
+    StrHeader *header = get_str_header(str);
+    if (owned && (header->refs == 1 || header->refs < 0)) return str;
+    
+    char *new_str = str_copy(str, 0);
+    if (owned) str_release(str);
     return new_str;
 }
+
+// Makes room to append to a string
+// A string we hold the only reference to grows in place; anything else is copied.
+// Either way, the capacity at least doubles, so appending in a loop is linear.
+static char *str_reserve(char *str, int64_t extra, int owned)
+{
+    StrHeader *header = get_str_header(str);
+    int64_t len = header->len;
+    int64_t needed = len + extra;
+    int unique = owned && header->refs == 1;
+    if (unique && header->cap >= needed) return str;
+    
+    int64_t cap = header->cap * 2;
+    if (cap < needed) cap = needed;
+    if (cap < 16) cap = 16;
+    
+    if (!unique) {
+        char *new_str = str_alloc(cap);
+        memcpy(new_str, str, len + 1);
+        get_str_header(new_str)->len = len;
+        if (owned) str_release(str);
+        return new_str;
+    }
+    
+    header = (StrHeader *)realloc(header, sizeof(StrHeader) + cap + 1);
+    header->cap = cap;
+    return (char *)(header + 1);
+}
+
+char *strappend_char(char *str, char c, int owned)
+{
+    str = str_reserve(str, 1, owned);
+    StrHeader *header = get_str_header(str);
+    
+    str[header->len] = c;
+    ++header->len;
+    str[header->len] = '\0';
+    return str;
+}
+
+char *strappend_str(char *str, const char *str2, int owned)
+{
+    int64_t len2 = get_str_header(str2)->len;
+    int self = str == str2;
+    
+    str = str_reserve(str, len2, owned);
+    if (self) str2 = str;
+    StrHeader *header = get_str_header(str);
+    
+    memcpy(str + header->len, str2, len2);
+    header->len += len2;
+    str[header->len] = '\0';
+    return str;
+}
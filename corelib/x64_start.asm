@@ -5,14 +5,27 @@
 .text
 .globl _start
 .extern main
+.extern str_init_args
 
 _start:
     xor ebp, ebp
-    mov esi, DWORD PTR [rsp+0]
-    lea rdi, 8[rsp]
+    mov r12, QWORD PTR [rsp+0]
+    lea r13, 8[rsp]
+    
+    # The arguments are C strings, and Orka strings need their header
+    mov rdi, r13
+    mov rsi, r12
+    call str_init_args
+    
+    mov rsi, r12
+    mov rdi, r13
     call main
     
-    mov rdi, rax
+    # Buffered output has to go out before we exit
+    mov rbx, rax
+    call flush
+    
+    mov rdi, rbx
     mov rax, 60
     syscall
 
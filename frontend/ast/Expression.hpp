@@ -46,6 +46,26 @@ public:
     void print();
 };
 
+// Represents a logical not expression
+class AstNotOp : public AstUnaryOp {
+public:
+    AstNotOp() {
+        this->type = AstType::Not;
+    }
+    
+    void print();
+};
+
+// Represents a bitwise not expression
+class AstBitNotOp : public AstUnaryOp {
+public:
+    AstBitNotOp() {
+        this->type = AstType::BitNot;
+    }
+    
+    void print();
+};
+
 // Represents the base of a binary expression
 class AstBinaryOp : public AstExpression {
 public:
@@ -100,6 +120,66 @@ public:
     void print();
 };
 
+// Represents a modulo operation
+class AstModOp : public AstBinaryOp {
+public:
+    AstModOp() {
+        this->type = AstType::Mod;
+    }
+    
+    void print();
+};
+
+// Represents a bitwise and operation
+class AstBitAndOp : public AstBinaryOp {
+public:
+    AstBitAndOp() {
+        this->type = AstType::BitAnd;
+    }
+    
+    void print();
+};
+
+// Represents a bitwise or operation
+class AstBitOrOp : public AstBinaryOp {
+public:
+    AstBitOrOp() {
+        this->type = AstType::BitOr;
+    }
+    
+    void print();
+};
+
+// Represents a bitwise xor operation
+class AstBitXorOp : public AstBinaryOp {
+public:
+    AstBitXorOp() {
+        this->type = AstType::BitXor;
+    }
+    
+    void print();
+};
+
+// Represents a left shift operation
+class AstLshOp : public AstBinaryOp {
+public:
+    AstLshOp() {
+        this->type = AstType::Lsh;
+    }
+    
+    void print();
+};
+
+// Represents a right shift operation
+class AstRshOp : public AstBinaryOp {
+public:
+    AstRshOp() {
+        this->type = AstType::Rsh;
+    }
+    
+    void print();
+};
+
 // Represents an equal-to operation
 class AstEQOp : public AstBinaryOp {
 public:
@@ -160,6 +240,26 @@ public:
     void print();
 };
 
+// Represents a logical and operation
+class AstAndOp : public AstBinaryOp {
+public:
+    AstAndOp() {
+        this->type = AstType::And;
+    }
+    
+    void print();
+};
+
+// Represents a logical or operation
+class AstOrOp : public AstBinaryOp {
+public:
+    AstOrOp() {
+        this->type = AstType::Or;
+    }
+    
+    void print();
+};
+
 // Represents a boolean literal
 class AstBool : public AstExpression {
 public:
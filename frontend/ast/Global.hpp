@@ -35,6 +35,7 @@ public:
     }
     
     void setArguments(std::vector<Var> args) { this->args = args; }
+    void setVarArgs(bool varArgs) { this->varArgs = varArgs; }
     
     void setDataType(DataType dataType) {
         this->dataType = dataType;
@@ -43,10 +44,12 @@ public:
     std::string getName() { return name; }
     DataType getDataType() { return dataType; }
     std::vector<Var> getArguments() { return args; }
+    bool isVarArgs() { return varArgs; }
     void print() override;
 private:
     std::string name = "";
     std::vector<Var> args;
+    bool varArgs = false;
     DataType dataType = DataType::Void;
 };
 
@@ -66,6 +69,8 @@ public:
     AstBlock *getBlock() { return block; }
     
     void setName(std::string name) { this->name = name; }
+    void setUnchecked(bool unchecked) { this->unchecked = unchecked; }
+    bool isUnchecked() { return unchecked; }
     
     void setArguments(std::vector<Var> args) { this->args = args; }
     
@@ -90,6 +95,54 @@ private:
     DataType dataType = DataType::Void;
     DataType ptrType = DataType::Void;
     std::string dtName = "";
+    bool unchecked = false;
+};
+
+// Represents a global variable or constant array
+// A scalar has an optional init expression; an array has either a size, or (if it is
+// constant) its elements. An embedded file is kept as raw bytes instead.
+class AstGlobalVar : public AstGlobalStatement {
+public:
+    explicit AstGlobalVar(std::string name, DataType dataType) : AstGlobalStatement(AstType::GlobalVar) {
+        this->name = name;
+        this->dataType = dataType;
+    }
+    
+    void setPtrType(DataType dataType) { this->ptrType = dataType; }
+    void setPtrSize(AstExpression *size) { this->size = size; }
+    void setExpression(AstExpression *expr) { this->expr = expr; }
+    void setConstant(bool constant) { this->constant = constant; }
+    
+    void addElement(AstExpression *element) {
+        elements.push_back(element);
+    }
+    
+    void setData(std::string data) {
+        this->data = data;
+        embedded = true;
+    }
+    
+    std::string getName() { return name; }
+    DataType getDataType() { return dataType; }
+    DataType getPtrType() { return ptrType; }
+    AstExpression *getPtrSize() { return size; }
+    AstExpression *getExpression() { return expr; }
+    std::vector<AstExpression *> getElements() { return elements; }
+    bool isConstant() { return constant; }
+    std::string getData() { return data; }
+    bool isEmbedded() { return embedded; }
+    
+    void print() override;
+private:
+    std::string name = "";
+    DataType dataType = DataType::Void;
+    DataType ptrType = DataType::Void;
+    AstExpression *size = nullptr;
+    AstExpression *expr = nullptr;
+    std::vector<AstExpression *> elements;
+    std::string data = "";
+    bool constant = false;
+    bool embedded = false;
 };
 
 // Represents a class
@@ -271,6 +271,38 @@ private:
     AstID *indexVar, *arrayVar;
 };
 
+// Represents a match statement
+// The branches are case statements, optionally followed by an else statement
+class AstMatchStmt : public AstStatement {
+public:
+    explicit AstMatchStmt() : AstStatement(AstType::Match) {}
+    
+    void addBranch(AstStatement *stmt) { branches.push_back(stmt); }
+    std::vector<AstStatement *> getBranches() { return branches; }
+    
+    void print();
+private:
+    std::vector<AstStatement *> branches;
+};
+
+// Represents a case within a match statement
+// The expressions are the values that select this case
+class AstCaseStmt : public AstBlockStmt {
+public:
+    explicit AstCaseStmt() : AstBlockStmt(AstType::Case) {}
+    
+    void print();
+};
+
+// Represents an arena block
+// Everything allocated inside is released together when the block ends
+class AstArenaStmt : public AstBlockStmt {
+public:
+    explicit AstArenaStmt() : AstBlockStmt(AstType::Arena) {}
+    
+    void print();
+};
+
 // Represents a break statement for a loop
 class AstBreak : public AstStatement {
 public:
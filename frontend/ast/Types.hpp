@@ -12,6 +12,7 @@ enum class AstType {
     EmptyAst,
     ExternFunc,
     Func,
+    GlobalVar,
     Return,
     
     FuncCallStmt,
@@ -32,17 +33,29 @@ enum class AstType {
     Repeat,
     For,
     ForAll,
+    Match,
+    Case,
+    Arena,
     End,
     
     Break,
     Continue,
     
     Neg,
+    Not,
+    BitNot,
     
     Add,
     Sub,
     Mul,
     Div,
+    Mod,
+    
+    BitAnd,
+    BitOr,
+    BitXor,
+    Lsh,
+    Rsh,
     
     EQ,
     NEQ,
@@ -51,6 +64,9 @@ enum class AstType {
     GTE,
     LTE,
     
+    And,
+    Or,
+    
     BoolL,
     CharL,
     ByteL,
@@ -51,11 +51,39 @@ void AstExternFunction::print() {
             std::cout << "*" << printDataType(var.subType);
         std::cout << ", ";
     }
+    if (varArgs) std::cout << "...";
     std::cout << ") ";
     std::cout << " -> " << printDataType(dataType);
     std::cout << std::endl;
 }
 
+void AstGlobalVar::print() {
+    if (constant) std::cout << "CONST ";
+    std::cout << "GLOBAL " << name << " : " << printDataType(dataType);
+    if (dataType == DataType::Array) {
+        std::cout << "*" << printDataType(ptrType) << "[";
+        if (size) size->print();
+        else if (embedded) std::cout << data.length();
+        else std::cout << elements.size();
+        std::cout << "]";
+    }
+    if (embedded) std::cout << " EMBED";
+    std::cout << std::endl;
+    
+    if (expr) {
+        for (int i = 0; i<8; i++) std::cout << " ";
+        expr->print();
+        std::cout << std::endl;
+    }
+    
+    for (auto element : elements) {
+        for (int i = 0; i<8; i++) std::cout << " ";
+        element->print();
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
 void AstFunction::print() {
     std::cout << "FUNC " << name << "(";
     for (auto var : args) {
@@ -68,6 +96,7 @@ void AstFunction::print() {
     }
     std::cout << ") -> ";
     std::cout << printDataType(dataType);
+    if (unchecked) std::cout << " @unchecked";
     std::cout << std::endl;
     
     for (auto stmt : block->getBlock()) {
@@ -315,6 +344,58 @@ void AstForAllStmt::print() {
     std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
 }
 
+void AstMatchStmt::print() {
+    std::cout << "    ";
+    std::cout << "MATCH " << std::endl;
+    
+    std::cout << "=========================" << std::endl;
+    for (auto stmt : branches) {
+        stmt->print();
+    }
+    std::cout << "=========================" << std::endl;
+}
+
+void AstCaseStmt::print() {
+    std::cout << "    ";
+    std::cout << "CASE ";
+    for (auto expr : getExpressions()) {
+        expr->print();
+        std::cout << ", ";
+    }
+    std::cout << std::endl;
+    
+    std::cout << "-------------------------" << std::endl;
+    for (auto stmt : block->getBlock()) {
+        stmt->print();
+        if (stmt->getExpressionCount()) {
+            for (auto expr : stmt->getExpressions()) {
+                for (int i = 0; i<8; i++) std::cout << " ";
+                expr->print();
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout << "-------------------------" << std::endl;
+}
+
+void AstArenaStmt::print() {
+    std::cout << "    ";
+    std::cout << "ARENA" << std::endl;
+    
+    std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+    for (auto stmt : block->getBlock()) {
+        stmt->print();
+        if (stmt->getExpressionCount()) {
+            for (auto expr : stmt->getExpressions()) {
+                for (int i = 0; i<8; i++) std::cout << " ";
+                expr->print();
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout << "~~~~~~~~~~~~~~~~~~~~~~~~~" << std::endl;
+}
+
 void AstBreak::print() {
     std::cout << "    ";
     std::cout << "BREAK" << std::endl;
@@ -338,6 +419,12 @@ void AstNegOp::print() {
     std::cout << ")";
 }
 
+void AstNotOp::print() {
+    std::cout << "(NOT ";
+    val->print();
+    std::cout << ")";
+}
+
 void AstAddOp::print() {
     std::cout << "(";
     lval->print();
@@ -370,6 +457,60 @@ void AstDivOp::print() {
     std::cout << ")";
 }
 
+void AstBitNotOp::print() {
+    std::cout << "(~";
+    val->print();
+    std::cout << ")";
+}
+
+void AstModOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") % (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstBitAndOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") & (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstBitOrOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") | (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstBitXorOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") ^ (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstLshOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") << (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstRshOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") >> (";
+    rval->print();
+    std::cout << ")";
+}
+
 void AstEQOp::print() {
     std::cout << "(";
     lval->print();
@@ -418,6 +559,22 @@ void AstLTEOp::print() {
     std::cout << ")";
 }
 
+void AstAndOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") AND (";
+    rval->print();
+    std::cout << ")";
+}
+
+void AstOrOp::print() {
+    std::cout << "(";
+    lval->print();
+    std::cout << ") OR (";
+    rval->print();
+    std::cout << ")";
+}
+
 void AstBool::print() {
     if (val == 0) std::cout << "FALSE";
     else std::cout << "TRUE";
@@ -35,7 +35,14 @@ void Token::print() {
         case In: std::cout << "IN"; break;
         case Sizeof: std::cout << "SIZEOF"; break;
         case Import: std::cout << "IMPORT"; break;
+        case Embed: std::cout << "EMBED"; break;
         case Step: std::cout << "STEP"; break;
+        case Match: std::cout << "MATCH"; break;
+        case Case: std::cout << "CASE"; break;
+        case Arena: std::cout << "ARENA"; break;
+        case And: std::cout << "AND"; break;
+        case Or: std::cout << "OR"; break;
+        case Not: std::cout << "NOT"; break;
         
         case Bool: std::cout << "BOOL"; break;
         case Char: std::cout << "CHAR"; break;
@@ -62,16 +69,28 @@ void Token::print() {
         case RParen: std::cout << ")"; break;
         case LBracket: std::cout << "["; break;
         case RBracket: std::cout << "]"; break;
+        case LBrace: std::cout << "{"; break;
+        case RBrace: std::cout << "}"; break;
         case Comma: std::cout << ", "; break;
         case Dot: std::cout << ". "; break;
         case Range: std::cout << ".. "; break;
+        case Ellipsis: std::cout << "... "; break;
         case Arrow: std::cout << "-> "; break;
         case Scope: std::cout << ":: "; break;
+        case At: std::cout << "@"; break;
         
         case Plus: std::cout << "+ "; break;
         case Minus: std::cout << "- "; break;
         case Mul: std::cout << "* "; break;
         case Div: std::cout << "/ "; break;
+        case Mod: std::cout << "% "; break;
+        
+        case BitAnd: std::cout << "& "; break;
+        case BitOr: std::cout << "| "; break;
+        case BitXor: std::cout << "^ "; break;
+        case BitNot: std::cout << "~ "; break;
+        case Lsh: std::cout << "<< "; break;
+        case Rsh: std::cout << ">> "; break;
         
         case EQ: std::cout << "== "; break;
         case NEQ: std::cout << "!= "; break;
@@ -13,6 +13,7 @@ Token::Token() {
     type = EmptyToken;
     id_val = "";
     i32_val = 0;
+    i64_val = 0;
 }
 
 // The scanner functions
@@ -55,7 +56,8 @@ Token Scanner::getNext() {
         
         rawBuffer += next;
         
-        if (next == '#') {
+        // A # in a string (like a printf flag) doesn't start a comment
+        if (next == '#' && !inQuote) {
             while (next != '\n' && !reader.eof()) {
                 next = reader.get();
                 rawBuffer += next;
@@ -150,13 +152,15 @@ Token Scanner::getNext() {
             
             if (isInt()) {
                 token.type = Int32;
-                token.i32_val = std::stoi(buffer);
+                token.i64_val = std::stoull(buffer);
+                token.i32_val = (int)token.i64_val;
             } else if (isHex()) {
                 token.type = Int32;
-                token.i32_val = std::stoi(buffer, 0, 16);
+                token.i64_val = std::stoull(buffer, 0, 16);
+                token.i32_val = (int)token.i64_val;
             } else if (isFloat()) {
                 token.type = FloatL;
-                token.flt_val = std::stof(buffer);
+                token.flt_val = std::stod(buffer);
             } else {
                 token.type = Id;
                 token.id_val = buffer;
@@ -189,11 +193,19 @@ bool Scanner::isSymbol(char c) {
         case ')':
         case '[':
         case ']':
+        case '{':
+        case '}':
         case ',': 
         case '+': 
         case '-': 
         case '*': 
         case '/': 
+        case '%':
+        case '&':
+        case '|':
+        case '^':
+        case '~':
+        case '@':
         case '>':
         case '<': 
         case '!': return true;
@@ -229,6 +241,7 @@ TokenType Scanner::getKeyword() {
     else if (buffer == "repeat") return Repeat;
     else if (buffer == "for") return For;
     else if (buffer == "forall") return ForAll;
+    else if (buffer == "arena") return Arena;
     else if (buffer == "is") return Is;
     else if (buffer == "then") return Then;
     else if (buffer == "do") return Do;
@@ -237,12 +250,18 @@ TokenType Scanner::getKeyword() {
     else if (buffer == "in") return In;
     else if (buffer == "sizeof") return Sizeof;
     else if (buffer == "import") return Import;
+    else if (buffer == "embed") return Embed;
     else if (buffer == "true") return True;
     else if (buffer == "false") return False;
     else if (buffer == "step") return Step;
     else if (buffer == "float") return Float;
     else if (buffer == "double") return Double;
     else if (buffer == "extends") return Extends;
+    else if (buffer == "match") return Match;
+    else if (buffer == "case") return Case;
+    else if (buffer == "and") return And;
+    else if (buffer == "or") return Or;
+    else if (buffer == "not") return Not;
     return EmptyToken;
 }
 
@@ -253,10 +272,18 @@ TokenType Scanner::getSymbol(char c) {
         case ')': return RParen;
         case '[': return LBracket;
         case ']': return RBracket;
+        case '{': return LBrace;
+        case '}': return RBrace;
         case ',': return Comma;
         case '+': return Plus;
         case '*': return Mul;
         case '/': return Div;
+        case '%': return Mod;
+        case '&': return BitAnd;
+        case '|': return BitOr;
+        case '^': return BitXor;
+        case '~': return BitNot;
+        case '@': return At;
         case '=': return EQ;
         
         case ':': {
@@ -278,6 +305,9 @@ TokenType Scanner::getSymbol(char c) {
             if (c2 == '=') {
                 rawBuffer += c2;
                 return GTE;
+            } else if (c2 == '>') {
+                rawBuffer += c2;
+                return Rsh;
             } else {
                 reader.unget();
                 return GT;
@@ -289,6 +319,9 @@ TokenType Scanner::getSymbol(char c) {
             if (c2 == '=') {
                 rawBuffer += c2;
                 return LTE;
+            } else if (c2 == '<') {
+                rawBuffer += c2;
+                return Lsh;
             } else {
                 reader.unget();
                 return LT;
@@ -309,6 +342,13 @@ TokenType Scanner::getSymbol(char c) {
             char c2 = reader.get();
             if (c2 == '.') {
                 rawBuffer += c2;
+                
+                char c3 = reader.get();
+                if (c3 == '.') {
+                    rawBuffer += c3;
+                    return Ellipsis;
+                }
+                reader.unget();
                 return Range;
             } else {
                 reader.unget();
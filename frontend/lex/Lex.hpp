@@ -8,6 +8,7 @@
 #include <fstream>
 #include <string>
 #include <stack>
+#include <cstdint>
 
 // Represents a token
 enum TokenType {
@@ -39,8 +40,15 @@ enum TokenType {
     In,
     Sizeof,
     Import,
+    Embed,
     Step,
     Extends,
+    Match,
+    Case,
+    Arena,
+    And,
+    Or,
+    Not,
     
     // Datatype Keywords
     Bool,
@@ -75,16 +83,28 @@ enum TokenType {
     RParen,
     LBracket,
     RBracket,
+    LBrace,
+    RBrace,
     Comma,
     Dot,
     Range,
+    Ellipsis,
     Arrow,
     Scope,
+    At,
     
     Plus,
     Minus,
     Mul,
     Div,
+    Mod,
+    
+    BitAnd,
+    BitOr,
+    BitXor,
+    BitNot,
+    Lsh,
+    Rsh,
     
     EQ,
     NEQ,
@@ -99,6 +119,7 @@ struct Token {
     std::string id_val;
     char i8_val;
     int i32_val;
+    uint64_t i64_val;
     double flt_val;
     
     Token();
@@ -193,6 +193,68 @@ bool Parser::buildForAll(AstBlock *block) {
     return true;
 }
 
+// Builds a match statement
+// Each case body runs until the next case, else, or the closing end
+bool Parser::buildMatch(AstBlock *block) {
+    AstMatchStmt *match = new AstMatchStmt;
+    if (!buildExpression(match, DataType::Void, Is)) return false;
+    block->addStatement(match);
+    
+    if (match->getExpressionCount() == 0) {
+        syntax->addError(scanner->getLine(), "Expected expression in match.");
+        return false;
+    }
+    
+    ++layer;
+    
+    Token token = scanner->getNext();
+    while (token.type != End && token.type != Eof) {
+        if (token.type == Case) {
+            AstCaseStmt *caseStmt = new AstCaseStmt;
+            if (!buildExpression(caseStmt, DataType::Void, Then, Comma)) return false;
+            match->addBranch(caseStmt);
+            
+            if (caseStmt->getExpressionCount() == 0) {
+                syntax->addError(scanner->getLine(), "Expected value in case.");
+                return false;
+            }
+            
+            if (!buildBlock(caseStmt->getBlockStmt(), layer, nullptr, true)) return false;
+        } else if (token.type == Else) {
+            AstElseStmt *elsee = new AstElseStmt;
+            match->addBranch(elsee);
+            
+            if (!buildBlock(elsee->getBlockStmt(), layer, nullptr, true)) return false;
+        } else if (token.type != Nl) {
+            syntax->addError(scanner->getLine(), "Expected \"case\" or \"else\" in match.");
+            token.print();
+            return false;
+        }
+        
+        token = scanner->getNext();
+    }
+    
+    --layer;
+    return true;
+}
+
+// Builds an arena block
+bool Parser::buildArena(AstBlock *block) {
+    AstArenaStmt *arena = new AstArenaStmt;
+    block->addStatement(arena);
+    
+    Token token = scanner->getNext();
+    if (token.type != Do) {
+        syntax->addError(scanner->getLine(), "Expected \"do\" after arena.");
+        return false;
+    }
+    
+    ++layer;
+    buildBlock(arena->getBlockStmt(), layer);
+    
+    return true;
+}
+
 // Builds a loop keyword
 bool Parser::buildLoopCtrl(AstBlock *block, bool isBreak) {
     if (isBreak) block->addStatement(new AstBreak);
@@ -9,11 +9,27 @@
 #include <ast.hpp>
 
 // Returns the function arguments
-bool Parser::getFunctionArgs(std::vector<Var> &args) {
+// Extern functions can end their arguments with "...", which sets varArgs
+bool Parser::getFunctionArgs(std::vector<Var> &args, bool *varArgs) {
     Token token = scanner->getNext();
     if (token.type == LParen) {
         token = scanner->getNext();
         while (token.type != Eof && token.type != RParen) {
+            if (token.type == Ellipsis) {
+                if (varArgs == nullptr) {
+                    syntax->addError(scanner->getLine(), "Only extern functions can take variable arguments.");
+                    return false;
+                }
+                
+                *varArgs = true;
+                token = scanner->getNext();
+                if (token.type != RParen) {
+                    syntax->addError(scanner->getLine(), "Expected \')\' after \'...\'.");
+                    return false;
+                }
+                break;
+            }
+            
             Token t1 = token;
             Token t2 = scanner->getNext();
             Token t3 = scanner->getNext();
@@ -89,6 +105,7 @@ bool Parser::getFunctionArgs(std::vector<Var> &args) {
             
             args.push_back(v);
             typeMap[v.name] = std::pair<DataType, DataType>(v.type, v.subType);
+            readOnly.erase(v.name);
         }
     } else {
         scanner->rewind(token);
@@ -99,7 +116,9 @@ bool Parser::getFunctionArgs(std::vector<Var> &args) {
 
 // Builds a function
 bool Parser::buildFunction(Token startToken, std::string className) {
-    typeMap.clear();
+    // Globals are visible in every function, until a local of the same name hides them
+    typeMap = globalTypes;
+    readOnly = constArrays;
     localConsts.clear();
     
     Token token;
@@ -132,7 +151,8 @@ bool Parser::buildFunction(Token startToken, std::string className) {
         typeMap["this"] = std::pair<DataType, DataType>(classV.type, classV.subType);
     }
     
-    if (!getFunctionArgs(args)) return false;
+    bool varArgs = false;
+    if (!getFunctionArgs(args, isExtern ? &varArgs : nullptr)) return false;
 
     // Check to see if there's any return type
     token = scanner->getNext();
@@ -200,6 +220,7 @@ bool Parser::buildFunction(Token startToken, std::string className) {
     if (isExtern) {
         AstExternFunction *ex = new AstExternFunction(funcName);
         ex->setArguments(args);
+        ex->setVarArgs(varArgs);
         ex->setDataType(funcType);
         tree->addGlobalStatement(ex);
         return true;
@@ -207,6 +228,8 @@ bool Parser::buildFunction(Token startToken, std::string className) {
     
     AstFunction *func = new AstFunction(funcName);
     func->setDataType(funcType, ptrType);
+    func->setUnchecked(uncheckedAttr);
+    uncheckedAttr = false;
     if (funcType == DataType::Struct) func->setDataTypeName(retName);
     func->setArguments(args);
     
@@ -287,3 +310,22 @@ bool Parser::buildReturn(AstBlock *block) {
     return true;
 }
 
+
+// Builds a function attribute
+// Attributes are written before the function they apply to (ie, "@unchecked")
+bool Parser::buildAttribute() {
+    Token token = scanner->getNext();
+    if (token.type != Id) {
+        syntax->addError(scanner->getLine(), "Expected attribute name.");
+        return false;
+    }
+    
+    if (token.id_val == "unchecked") {
+        uncheckedAttr = true;
+    } else {
+        syntax->addError(scanner->getLine(), "Unknown attribute: " + token.id_val);
+        return false;
+    }
+    
+    return true;
+}
@@ -32,6 +32,9 @@ bool Parser::parse() {
                 code = buildFunction(token);
             } break;
             
+            case At: code = buildAttribute(); break;
+            
+            case VarD: code = buildGlobalVariable(); break;
             case Const: code = buildConst(true); break;
             case Enum: code = buildEnum(); break;
             case Struct: code = buildStruct(); break;
@@ -122,6 +125,22 @@ bool Parser::buildBlock(AstBlock *block, int stopLayer, AstIfStmt *parentBlock,
             case For: code = buildFor(block); break;
             case ForAll: code = buildForAll(block); break;
             
+            // Handle match statements
+            // A case ends the body of the case before it, so it works like ELIF
+            case Match: code = buildMatch(block); break;
+            case Case: {
+                if (inElif) {
+                    scanner->rewind(token);
+                    end = true;
+                } else {
+                    syntax->addError(scanner->getLine(), "Case outside of match statement.");
+                    return false;
+                }
+            } break;
+            
+            // Handle arena blocks
+            case Arena: code = buildArena(block); break;
+            
             case Break: code = buildLoopCtrl(block, true); break;
             case Continue: code = buildLoopCtrl(block, false); break;
             
@@ -169,6 +188,10 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
     Token token = scanner->getNext();
     while (token.type != Eof && token.type != stopToken) {
         if (token.type == separateToken && output.size() > 0) {
+            while (opStack.size() > 0) {
+                buildOperator(output, opStack, varType);
+            }
+            
             AstExpression *expr = output.top();
             output.pop();
             
@@ -182,6 +205,9 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
             } else {
                 stmt->addExpression(expr);
             }
+            
+            // The next expression starts fresh, so a '-' there is a negation
+            lastWasOp = true;
             continue;
         }
     
@@ -204,8 +230,14 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
             
             case Int32: {
                 lastWasOp = false;
-                AstInt *i32 = new AstInt(token.i32_val);
-                output.push(i32);
+                // Literals that don't fit in 32 bits are 64-bit from the start
+                if (token.i64_val > 0x7FFFFFFF) {
+                    AstQWord *i64 = new AstQWord(token.i64_val);
+                    output.push(i64);
+                } else {
+                    AstInt *i32 = new AstInt(token.i64_val);
+                    output.push(i32);
+                }
             } break;
             
             case FloatL: {
@@ -345,57 +377,40 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
             
             case Plus: 
             case Minus: {
-                if (opStack.size() > 0) {
-                    AstType type = opStack.top()->getType();
-                    if (type == AstType::Mul || type == AstType::Div) {
-                        AstExpression *rval = checkExpression(output.top(), varType);
-                        output.pop();
-                        
-                        AstExpression *lval = checkExpression(output.top(), varType);
-                        output.pop();
-                        
-                        AstBinaryOp *op = static_cast<AstBinaryOp *>(opStack.top());
-                        opStack.pop();
-                        
-                        op->setLVal(lval);
-                        op->setRVal(rval);
-                        output.push(op);
-                    }
-                }
-                
-                if (token.type == Plus) {
-                    AstAddOp *add = new AstAddOp;
-                    opStack.push(add);
+                if (token.type == Minus && lastWasOp) {
+                    opStack.push(new AstNegOp);
+                } else if (token.type == Plus) {
+                    pushOperator(new AstAddOp, output, opStack, varType);
                 } else {
-                    if (lastWasOp) {
-                        opStack.push(new AstNegOp);
-                    } else {
-                        AstSubOp *sub = new AstSubOp;
-                        opStack.push(sub);
-                    }
+                    pushOperator(new AstSubOp, output, opStack, varType);
                 }
                 
                 lastWasOp = true;
             } break;
             
-            case Mul: {
-                lastWasOp = true;
-                AstMulOp *mul = new AstMulOp;
-                opStack.push(mul);
-            } break;
+            case Mul: pushOperator(new AstMulOp, output, opStack, varType); lastWasOp = true; break;
+            case Div: pushOperator(new AstDivOp, output, opStack, varType); lastWasOp = true; break;
+            case Mod: pushOperator(new AstModOp, output, opStack, varType); lastWasOp = true; break;
             
-            case Div: {
-                lastWasOp = true;
-                AstDivOp *div = new AstDivOp;
-                opStack.push(div);
-            } break;
+            case BitAnd: pushOperator(new AstBitAndOp, output, opStack, varType); lastWasOp = true; break;
+            case BitOr: pushOperator(new AstBitOrOp, output, opStack, varType); lastWasOp = true; break;
+            case BitXor: pushOperator(new AstBitXorOp, output, opStack, varType); lastWasOp = true; break;
+            case Lsh: pushOperator(new AstLshOp, output, opStack, varType); lastWasOp = true; break;
+            case Rsh: pushOperator(new AstRshOp, output, opStack, varType); lastWasOp = true; break;
             
-            case EQ: opStack.push(new AstEQOp); lastWasOp = true; break;
-            case NEQ: opStack.push(new AstNEQOp); lastWasOp = true; break;
-            case GT: opStack.push(new AstGTOp); lastWasOp = true; break;
-            case LT: opStack.push(new AstLTOp); lastWasOp = true; break;
-            case GTE: opStack.push(new AstGTEOp); lastWasOp = true; break;
-            case LTE: opStack.push(new AstLTEOp); lastWasOp = true; break;
+            case EQ: pushOperator(new AstEQOp, output, opStack, varType); lastWasOp = true; break;
+            case NEQ: pushOperator(new AstNEQOp, output, opStack, varType); lastWasOp = true; break;
+            case GT: pushOperator(new AstGTOp, output, opStack, varType); lastWasOp = true; break;
+            case LT: pushOperator(new AstLTOp, output, opStack, varType); lastWasOp = true; break;
+            case GTE: pushOperator(new AstGTEOp, output, opStack, varType); lastWasOp = true; break;
+            case LTE: pushOperator(new AstLTEOp, output, opStack, varType); lastWasOp = true; break;
+            
+            case And: pushOperator(new AstAndOp, output, opStack, varType); lastWasOp = true; break;
+            case Or: pushOperator(new AstOrOp, output, opStack, varType); lastWasOp = true; break;
+            
+            // Prefix operators
+            case Not: opStack.push(new AstNotOp); lastWasOp = true; break;
+            case BitNot: opStack.push(new AstBitNotOp); lastWasOp = true; break;
             
             case Step: {
                 lastWasOp = false;       
@@ -419,11 +434,12 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
         }
         
         if (!lastWasOp && opStack.size() > 0) {
-            if (opStack.top()->getType() == AstType::Neg) {
+            AstType type = opStack.top()->getType();
+            if (type == AstType::Neg || type == AstType::BitNot) {
                 AstExpression *val = checkExpression(output.top(), varType);
                 output.pop();
                 
-                AstNegOp *op = static_cast<AstNegOp *>(opStack.top());
+                AstUnaryOp *op = static_cast<AstUnaryOp *>(opStack.top());
                 opStack.pop();
                 op->setVal(val);
                 output.push(op);
@@ -435,18 +451,7 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
     
     // Build the expression
     while (opStack.size() > 0) {
-        AstExpression *rval = checkExpression(output.top(), varType);
-        output.pop();
-        
-        AstExpression *lval = checkExpression(output.top(), varType);
-        output.pop();
-        
-        AstBinaryOp *op = static_cast<AstBinaryOp *>(opStack.top());
-        opStack.pop();
-        
-        op->setLVal(lval);
-        op->setRVal(rval);
-        output.push(op);
+        buildOperator(output, opStack, varType);
     }
     
     // Add the expressions back
@@ -473,6 +478,92 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
     return true;
 }
 
+// Returns how tightly an operator binds; higher values bind tighter
+int Parser::getPrecedence(AstType type) {
+    switch (type) {
+        case AstType::Neg:
+        case AstType::BitNot: return 10;
+        
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Mod: return 9;
+        
+        case AstType::Add:
+        case AstType::Sub: return 8;
+        
+        case AstType::Lsh:
+        case AstType::Rsh: return 7;
+        
+        case AstType::BitAnd: return 6;
+        case AstType::BitXor: return 5;
+        case AstType::BitOr: return 4;
+        
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: return 3;
+        
+        case AstType::Not: return 2;
+        case AstType::And: return 1;
+        
+        default: {}
+    }
+    
+    return 0;
+}
+
+// Pushes a binary operator to the operator stack
+// Any operators already on the stack that bind at least as tightly are built first
+void Parser::pushOperator(AstExpression *op, std::stack<AstExpression *> &output,
+                          std::stack<AstExpression *> &opStack, DataType varType) {
+    int precedence = getPrecedence(op->getType());
+    
+    while (opStack.size() > 0 && getPrecedence(opStack.top()->getType()) >= precedence) {
+        buildOperator(output, opStack, varType);
+    }
+    
+    opStack.push(op);
+}
+
+// Pops the top operator, and builds it from the operands on the output stack
+void Parser::buildOperator(std::stack<AstExpression *> &output, std::stack<AstExpression *> &opStack, DataType varType) {
+    AstType type = opStack.top()->getType();
+    
+    if (type == AstType::Not || type == AstType::Neg || type == AstType::BitNot) {
+        AstExpression *val = checkExpression(output.top(), varType);
+        output.pop();
+        
+        AstUnaryOp *op = static_cast<AstUnaryOp *>(opStack.top());
+        opStack.pop();
+        
+        if (type == AstType::Not) val = checkCondExpression(val);
+        op->setVal(val);
+        output.push(op);
+        return;
+    }
+
+    AstExpression *rval = checkExpression(output.top(), varType);
+    output.pop();
+    
+    AstExpression *lval = checkExpression(output.top(), varType);
+    output.pop();
+    
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(opStack.top());
+    opStack.pop();
+    
+    // Plain variables used as logical operands are expanded to a comparison
+    if (op->getType() == AstType::And || op->getType() == AstType::Or) {
+        lval = checkCondExpression(lval);
+        rval = checkCondExpression(rval);
+    }
+    
+    op->setLVal(lval);
+    op->setRVal(rval);
+    output.push(op);
+}
+
 // This is meant mainly for literals; it checks to make sure all the types in
 // the expression agree in type. LLVM will have a problem if not
 AstExpression *Parser::checkExpression(AstExpression *expr, DataType varType) {
@@ -7,6 +7,8 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <stack>
 
 #include <lex/Lex.hpp>
 #include <error/Manager.hpp>
@@ -28,8 +30,9 @@ public:
     void debugScanner();
 protected:
     // Function.cpp
-    bool getFunctionArgs(std::vector<Var> &args);
+    bool getFunctionArgs(std::vector<Var> &args, bool *varArgs = nullptr);
     bool buildFunction(Token startToken, std::string className = "");
+    bool buildAttribute();
     bool buildFunctionCallStmt(AstBlock *block, Token idToken);
     bool buildReturn(AstBlock *block);
     
@@ -38,6 +41,9 @@ protected:
     bool buildVariableAssign(AstBlock *block, Token idToken);
     bool buildArrayAssign(AstBlock *block, Token idToken);
     bool buildConst(bool isGlobal);
+    bool buildConstArray(std::string name, DataType dataType, bool isGlobal);
+    bool buildEmbed(std::string name, DataType dataType);
+    bool buildGlobalVariable();
     
     // Flow.cpp
     bool buildConditional(AstBlock *block);
@@ -47,6 +53,8 @@ protected:
     bool buildRepeat(AstBlock *block);
     bool buildFor(AstBlock *block);
     bool buildForAll(AstBlock *block);
+    bool buildMatch(AstBlock *block);
+    bool buildArena(AstBlock *block);
     bool buildLoopCtrl(AstBlock *block, bool isBreak);
     
     // Structure.cpp
@@ -64,6 +72,10 @@ protected:
                         AstExpression **dest = nullptr, bool isConst = false);
     AstExpression *checkExpression(AstExpression *expr, DataType varType);
     AstExpression *checkCondExpression(AstExpression *toCheck);
+    int getPrecedence(AstType type);
+    void pushOperator(AstExpression *op, std::stack<AstExpression *> &output,
+                      std::stack<AstExpression *> &opStack, DataType varType);
+    void buildOperator(std::stack<AstExpression *> &output, std::stack<AstExpression *> &opStack, DataType varType);
     int isConstant(std::string name);
 private:
     std::string input = "";
@@ -73,7 +85,13 @@ private:
     int layer = 0;
     AstClass *currentClass = nullptr;
     
+    // Attributes that apply to the next function
+    bool uncheckedAttr = false;
+    
     std::map<std::string, std::pair<DataType,DataType>> typeMap;
+    std::map<std::string, std::pair<DataType,DataType>> globalTypes;
+    std::set<std::string> constArrays;
+    std::set<std::string> readOnly;
     std::map<std::string, std::string> classMap;
     std::map<std::string, std::pair<DataType, AstExpression*>> globalConsts;
     std::map<std::string, std::pair<DataType, AstExpression*>> localConsts;
@@ -4,6 +4,8 @@
 // Orka is licensed under the BSD-3 license. See the COPYING file for more information.
 //
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -85,41 +87,15 @@ bool Parser::buildVariableDec(AstBlock *block) {
             return false;
         }
         
+        // The backend allocates the elements, since only it knows the element size
         for (std::string name : toDeclare) {
             AstVarDec *vd = new AstVarDec(name, DataType::Array);
             block->addStatement(vd);
-            vd->addExpression(empty->getExpression());
             vd->setPtrType(dataType);
-            
-            // Create an assignment to a malloc call
-            AstVarAssign *va = new AstVarAssign(name);
-            va->setDataType(DataType::Array);
-            va->setPtrType(dataType);
-            block->addStatement(va);
-            
-            AstFuncCallExpr *callMalloc = new AstFuncCallExpr("malloc");
-            callMalloc->setArguments(vd->getExpressions());
-            va->addExpression(callMalloc);
-            
-            // In order to get a proper malloc, we need to multiply the argument by
-            // the size of the type. Get the arguments, and do that
-            AstExpression *arg = callMalloc->getArguments().at(0);
-            callMalloc->clearArguments();
-            
-            AstInt *size;
-            if (dataType == DataType::Int32) size = new AstInt(4);
-            else if (dataType == DataType::String) size = new AstInt(8);
-            else size = new AstInt(1);
-            
-            AstMulOp *op = new AstMulOp;
-            op->setLVal(size);
-            op->setRVal(arg);
-            callMalloc->addArgument(op);
-            
-            // Finally, set the size of the declaration
-            vd->setPtrSize(arg);
+            vd->setPtrSize(empty->getExpression());
             
             typeMap[name] = std::pair<DataType, DataType>(DataType::Array, dataType);
+            readOnly.erase(name);
         }
     
     // We're at the end of the declaration
@@ -138,6 +114,7 @@ bool Parser::buildVariableDec(AstBlock *block) {
             
             auto typePair = std::pair<DataType, DataType>(dataType, DataType::Void);
             typeMap[name] = typePair;
+            readOnly.erase(name);
     
             AstVarAssign *va = new AstVarAssign(name);
             va->setDataType(dataType);
@@ -151,6 +128,11 @@ bool Parser::buildVariableDec(AstBlock *block) {
 
 // Builds a variable assignment
 bool Parser::buildVariableAssign(AstBlock *block, Token idToken) {
+    if (readOnly.find(idToken.id_val) != readOnly.end()) {
+        syntax->addError(scanner->getLine(), "Cannot assign to a constant array.");
+        return false;
+    }
+    
     DataType dataType = typeMap[idToken.id_val].first;
     AstVarAssign *va = new AstVarAssign(idToken.id_val);
     va->setDataType(dataType);
@@ -168,6 +150,11 @@ bool Parser::buildVariableAssign(AstBlock *block, Token idToken) {
 
 // Builds an array assignment
 bool Parser::buildArrayAssign(AstBlock *block, Token idToken) {
+    if (readOnly.find(idToken.id_val) != readOnly.end()) {
+        syntax->addError(scanner->getLine(), "Cannot assign to a constant array.");
+        return false;
+    }
+    
     DataType dataType = typeMap[idToken.id_val].second;
     AstArrayAssign *pa = new AstArrayAssign(idToken.id_val);
     pa->setDataType(typeMap[idToken.id_val].first);
@@ -221,6 +208,8 @@ bool Parser::buildConst(bool isGlobal) {
         case Int64: dataType = DataType::Int64; break;
         case UInt64: dataType = DataType::UInt64; break;
         case Str: dataType = DataType::String; break;
+        case Float: dataType = DataType::Float; break;
+        case Double: dataType = DataType::Double; break;
         
         default: {
             syntax->addError(scanner->getLine(), "Unknown data type.");
@@ -230,6 +219,8 @@ bool Parser::buildConst(bool isGlobal) {
     
     // Final syntax check
     token = scanner->getNext();
+    if (token.type == LBracket) return buildConstArray(name, dataType, isGlobal);
+    
     if (token.type != Assign) {
         syntax->addError(scanner->getLine(), "Expected \'=\' after const assignment.");
         return false;
@@ -248,3 +239,194 @@ bool Parser::buildConst(bool isGlobal) {
     
     return true;
 }
+
+// Builds a constant array
+// The elements are listed in braces, and the array is as long as the list. The table
+// is built by the compiler, so the program doesn't fill it in when it starts.
+bool Parser::buildConstArray(std::string name, DataType dataType, bool isGlobal) {
+    if (!isGlobal) {
+        syntax->addError(scanner->getLine(), "Constant arrays must be global.");
+        return false;
+    }
+    
+    Token token = scanner->getNext();
+    if (token.type != RBracket) {
+        syntax->addError(scanner->getLine(), "Expected \']\' in constant array.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Assign) {
+        syntax->addError(scanner->getLine(), "Expected \'=\' after const assignment.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type == Embed) return buildEmbed(name, dataType);
+    
+    if (token.type != LBrace) {
+        syntax->addError(scanner->getLine(), "Expected \'{\' in constant array.");
+        return false;
+    }
+    
+    // Build the elements. We create a dummy statement for this
+    AstVarAssign *empty = new AstVarAssign("");
+    if (!buildExpression(empty, dataType, RBrace, Comma, nullptr, true)) return false;
+    
+    token = scanner->getNext();
+    if (token.type != SemiColon) {
+        syntax->addError(scanner->getLine(), "Error: Expected \';\'.");
+        return false;
+    }
+    
+    if (empty->getExpressionCount() == 0) {
+        syntax->addError(scanner->getLine(), "Constant arrays can't be empty.");
+        return false;
+    }
+    
+    AstGlobalVar *gv = new AstGlobalVar(name, DataType::Array);
+    gv->setPtrType(dataType);
+    gv->setConstant(true);
+    for (auto element : empty->getExpressions()) gv->addElement(element);
+    tree->addGlobalStatement(gv);
+    
+    globalTypes[name] = std::pair<DataType, DataType>(DataType::Array, dataType);
+    constArrays.insert(name);
+    return true;
+}
+
+// Builds a constant array from an embedded file
+// The file's bytes are kept as they are, rather than as an expression for each one,
+// so large files don't slow the compiler down.
+bool Parser::buildEmbed(std::string name, DataType dataType) {
+    if (dataType != DataType::Byte && dataType != DataType::UByte && dataType != DataType::Char) {
+        syntax->addError(scanner->getLine(), "Embedded files must be byte arrays.");
+        return false;
+    }
+    
+    Token token = scanner->getNext();
+    Token pathToken = scanner->getNext();
+    Token token2 = scanner->getNext();
+    
+    if (token.type != LParen || pathToken.type != String || token2.type != RParen) {
+        syntax->addError(scanner->getLine(), "Expected file path in embed.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != SemiColon) {
+        syntax->addError(scanner->getLine(), "Error: Expected \';\'.");
+        return false;
+    }
+    
+    std::ifstream reader(pathToken.id_val, std::ios::binary);
+    if (!reader.is_open()) {
+        syntax->addError(scanner->getLine(), "Unable to open embedded file: " + pathToken.id_val);
+        return false;
+    }
+    
+    std::ostringstream data;
+    data << reader.rdbuf();
+    
+    AstGlobalVar *gv = new AstGlobalVar(name, DataType::Array);
+    gv->setPtrType(dataType);
+    gv->setConstant(true);
+    gv->setData(data.str());
+    tree->addGlobalStatement(gv);
+    
+    globalTypes[name] = std::pair<DataType, DataType>(DataType::Array, dataType);
+    constArrays.insert(name);
+    return true;
+}
+
+// Builds a global variable
+// A scalar can have a constant init value; without one, it starts at zero. An
+// array is declared with its size, and its elements start at zero.
+bool Parser::buildGlobalVariable() {
+    Token token = scanner->getNext();
+    std::string name = token.id_val;
+    
+    if (token.type != Id) {
+        syntax->addError(scanner->getLine(), "Expected variable name.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Colon) {
+        syntax->addError(scanner->getLine(), "Expected \':\' in variable declaration.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    DataType dataType = DataType::Void;
+    
+    switch (token.type) {
+        case Bool: dataType = DataType::Bool; break;
+        case Char: dataType = DataType::Char; break;
+        case Byte: dataType = DataType::Byte; break;
+        case UByte: dataType = DataType::UByte; break;
+        case Short: dataType = DataType::Short; break;
+        case UShort: dataType = DataType::UShort; break;
+        case Int: dataType = DataType::Int32; break;
+        case UInt: dataType = DataType::UInt32; break;
+        case Int64: dataType = DataType::Int64; break;
+        case UInt64: dataType = DataType::UInt64; break;
+        case Str: dataType = DataType::String; break;
+        case Float: dataType = DataType::Float; break;
+        case Double: dataType = DataType::Double; break;
+        
+        case Id: {
+            if (enums.find(token.id_val) == enums.end()) {
+                syntax->addError(scanner->getLine(), "Unknown data type.");
+                return false;
+            }
+            
+            EnumDec dec = enums[token.id_val];
+            dataType = dec.type;
+        } break;
+        
+        default: {
+            syntax->addError(scanner->getLine(), "Unknown data type.");
+            return false;
+        }
+    }
+    
+    token = scanner->getNext();
+    
+    // We have an array
+    if (token.type == LBracket) {
+        AstExpression *size = nullptr;
+        if (!buildExpression(nullptr, DataType::Int32, RBracket, EmptyToken, &size, true)) return false;
+        
+        token = scanner->getNext();
+        if (token.type != SemiColon) {
+            syntax->addError(scanner->getLine(), "Error: Expected \';\'.");
+            return false;
+        }
+        
+        AstGlobalVar *gv = new AstGlobalVar(name, DataType::Array);
+        gv->setPtrType(dataType);
+        gv->setPtrSize(size);
+        tree->addGlobalStatement(gv);
+        
+        globalTypes[name] = std::pair<DataType, DataType>(DataType::Array, dataType);
+        return true;
+    }
+    
+    AstGlobalVar *gv = new AstGlobalVar(name, dataType);
+    tree->addGlobalStatement(gv);
+    globalTypes[name] = std::pair<DataType, DataType>(dataType, DataType::Void);
+    
+    if (token.type == SemiColon) return true;
+    
+    if (token.type != Assign) {
+        syntax->addError(scanner->getLine(), "Invalid token in variable declaration.");
+        return false;
+    }
+    
+    AstExpression *expr = nullptr;
+    if (!buildExpression(nullptr, dataType, SemiColon, EmptyToken, &expr, true)) return false;
+    gv->setExpression(expr);
+    
+    return true;
+}
@@ -22,6 +22,15 @@ std::string getInputPath(std::string input) {
     return name;
 }
 
+// Builds the path to a file named relative to another file
+std::string getRelativePath(std::string input, std::string path) {
+    if (path.length() > 0 && path.at(0) == '/') return path;
+    
+    size_t pos = input.find_last_of('/');
+    if (pos == std::string::npos) return path;
+    return input.substr(0, pos + 1) + path;
+}
+
 std::string preprocessFile(std::string input) {
     std::string newPath = "/tmp/" + getInputPath(input);
     Scanner *scanner = new Scanner(input);
@@ -36,6 +45,25 @@ std::string preprocessFile(std::string input) {
     while (!scanner->isEof() && token.type != Eof) {
         token = scanner->getNext();
         
+        // Embedded files are found relative to the file that names them
+        // The preprocessed file is somewhere else, so the parser gets the full path
+        if (token.type == Embed) {
+            writer << scanner->getRawBuffer();
+            token = scanner->getNext();
+            if (token.type == LParen) {
+                writer << scanner->getRawBuffer();
+                token = scanner->getNext();
+            }
+            
+            if (token.type == String) {
+                scanner->getRawBuffer();
+                writer << "\"" << getRelativePath(input, token.id_val) << "\"";
+            } else {
+                writer << scanner->getRawBuffer();
+            }
+            continue;
+        }
+        
         if (token.type != Import) {
             writer << scanner->getRawBuffer();
             continue;
@@ -50,6 +50,7 @@ AstTree *getAstTree(std::string input, bool testLex, bool printAst) {
 int compileLLVM(AstTree *tree, CFlags flags, bool printLLVM, bool emitLLVM, bool emitNVPTX) {
     Compiler *compiler = new Compiler(tree, flags);
     compiler->compile();
+    if (compiler->hasErrors()) return 1;
         
     if (printLLVM) {
         compiler->debug();
@@ -93,6 +94,7 @@ int main(int argc, char **argv) {
     CFlags flags;
     flags.name = "a.out";
     flags.nvptx = false;
+    flags.boundsCheck = false;
     
     // Other flags
     std::string input = "";
@@ -117,6 +119,8 @@ int main(int argc, char **argv) {
         } else if (arg == "--emit-nvptx") {
             emitNVPTX = true;
             flags.nvptx = true;
+        } else if (arg == "--bounds-check") {
+            flags.boundsCheck = true;
         } else if (arg == "--host") {
             useLLVM = false;
         } else if (arg == "-o") {
@@ -1,47 +1,24 @@
 #include <stdint.h>
+#include <stdarg.h>
 
-extern void syscall_str4(int code, int fd, const char *buf, int size);
+extern void write_bytes(const char *buf, int64_t len);
+extern void write_fd(int fd, const char *buf, int64_t len);
+extern void format_int(int64_t num);
+extern void format_hex(uint64_t num);
+extern int format_u64(char *buf, uint64_t value);
+extern int dtoa_shortest(double value, char *digits, int *exp10);
+extern int dtoa_precision(double value, int count, char *digits, int *point);
+extern int dtoa_fixed(double value, int frac, char *digits, int *point);
+extern char *str_new(int64_t len, char *buf);
 extern int strlen(const char *line);
 extern int stringcmp(const char *l1, const char *l2);
 
 // Needed for the floating point stuff
 int precision = 6;
 
-void printInt(int num)
+void printInt(int64_t num)
 {
-    // For some reason, weird things happen with just 0
-    if (num == 0) {
-        syscall_str4(1, 1, "0", 1);
-        return;
-    }
-    
-    if (num < 0) {
-        num *= -1;
-        syscall_str4(1, 1, "-", 1);
-    }
-
-    // Count the number of digits
-    int size = 0;
-    int num2 = num;
-    while (num2 != 0) {
-        num2 = num2 / 10;
-        ++size;
-    }
-    
-    // Convert to a string
-    char buf1[size];
-    int index = size - 1;
-    num2 = num;
-    
-    while (num2 != 0) {
-        int digit = num2 % 10;
-        num2 = num2 / 10;
-        buf1[index] = digit + '0';
-        --index;
-    }
-    
-    // Print
-    syscall_str4(1, 1, (char *)buf1, size);
+    format_int(num);
 }
 
 char getHex(int num)
@@ -63,164 +40,484 @@ char getHex(int num)
 
 void printHex(int num)
 {
-    if (num == 0) {
-        syscall_str4(1, 1, "0", 1);
-        return;
+    format_hex((uint32_t)num);
+}
+
+//
+// Formatting
+//
+// printf and snprintf share one formatting engine, which writes into a sink: either
+// the buffered standard output, or memory the caller provides. The compiler widens
+// variable arguments to 64 bits (and floats to doubles), so the length modifiers
+// (l, ll, h) are accepted but don't change anything.
+//
+// Conversions: %d %i %u %x %X %o %c %s %p %f %e %g %%, with the -, 0, +, space and
+// # flags, a width, and a precision (either can be * to take it from the arguments).
+// As before, %x prints upper-case digits.
+//
+
+#define FMT_BUFFER_SIZE     512
+#define MAX_PRECISION       40
+
+typedef struct
+{
+    char *buf;
+    int64_t cap;
+    int64_t len;
+    int fd;
+} Sink;
+
+typedef struct
+{
+    int left;
+    int zero;
+    int plus;
+    int space;
+    int alt;
+    int width;
+    int precision;
+} FormatSpec;
+
+static void sink_write(Sink *sink, const char *str, int64_t len)
+{
+    if (!sink->buf) {
+        write_fd(sink->fd, str, len);
+    } else {
+        for (int64_t i = 0; i<len && sink->len + i < sink->cap - 1; i++) {
+            sink->buf[sink->len + i] = str[i];
+        }
     }
     
-    if (num <= 15) {
-        char hex = getHex(num);
-        syscall_str4(1, 1, &hex, 1);
-        return;
+    // The length counts everything, even what didn't fit
+    sink->len += len;
+}
+
+static void sink_pad(Sink *sink, char c, int64_t count)
+{
+    char pad[16];
+    for (int i = 0; i<16; i++) pad[i] = c;
+    
+    while (count > 0) {
+        int64_t n = count < 16 ? count : 16;
+        sink_write(sink, pad, n);
+        count -= n;
+    }
+}
+
+// Writes a converted value padded out to the field width
+// The prefix (a sign or 0x) goes before any zero padding.
+static void sink_field(Sink *sink, FormatSpec *spec, const char *prefix, int prefixLen,
+                       const char *body, int64_t bodyLen)
+{
+    int64_t pad = spec->width - prefixLen - bodyLen;
+    if (pad < 0) pad = 0;
+    
+    if (!spec->left && !spec->zero) sink_pad(sink, ' ', pad);
+    sink_write(sink, prefix, prefixLen);
+    if (!spec->left && spec->zero) sink_pad(sink, '0', pad);
+    sink_write(sink, body, bodyLen);
+    if (spec->left) sink_pad(sink, ' ', pad);
+}
+
+static int format_radix(char *buf, uint64_t value, int shift, const char *digits)
+{
+    char tmp[64];
+    int index = 64;
+    uint64_t mask = (1 << shift) - 1;
+    
+    do {
+        tmp[--index] = digits[value & mask];
+        value >>= shift;
+    } while (value != 0);
+    
+    for (int i = index; i<64; i++) buf[i - index] = tmp[i];
+    return 64 - index;
+}
+
+static void format_integer(Sink *sink, FormatSpec *spec, char conv, uint64_t value, int negative)
+{
+    char digits[72];
+    int len;
+    
+    switch (conv) {
+        case 'x':
+        case 'X': len = format_radix(digits, value, 4, "0123456789ABCDEF"); break;
+        case 'p': len = format_radix(digits, value, 4, "0123456789abcdef"); break;
+        case 'o': len = format_radix(digits, value, 3, "01234567"); break;
+        default: len = format_u64(digits, value);
     }
     
-    // Determine length
-    int length = 1;
-    int num2 = num;
-    while (num2 > 15) {
-        length += 1;
-        num2 /= 16;
+    // A precision is the minimum number of digits, and turns off zero padding
+    char body[FMT_BUFFER_SIZE];
+    int bodyLen = 0;
+    if (spec->precision >= 0) {
+        spec->zero = 0;
+        if (spec->precision == 0 && value == 0) len = 0;
+        for (int i = len; i<spec->precision && bodyLen < MAX_PRECISION; i++) body[bodyLen++] = '0';
     }
+    for (int i = 0; i<len; i++) body[bodyLen++] = digits[i];
     
-    char number[length];
-    int index = length - 1;
+    char prefix[2];
+    int prefixLen = 0;
+    if (negative) prefix[prefixLen++] = '-';
+    else if (spec->plus && (conv == 'd' || conv == 'i')) prefix[prefixLen++] = '+';
+    else if (spec->space && (conv == 'd' || conv == 'i')) prefix[prefixLen++] = ' ';
     
-    // Now print
-    while (num > 15) {
-        int digit = num % 16;
-        num /= 16;
-        
-        number[index] = getHex(digit);
-        --index;
+    if (conv == 'p' || (spec->alt && (conv == 'x' || conv == 'X') && value != 0)) {
+        prefix[prefixLen++] = '0';
+        prefix[prefixLen++] = conv == 'X' ? 'X' : 'x';
+    } else if (spec->alt && conv == 'o' && (bodyLen == 0 || body[0] != '0')) {
+        prefix[prefixLen++] = '0';
     }
     
-    number[index] = getHex(num);
+    sink_field(sink, spec, prefix, prefixLen, body, bodyLen);
+}
+
+// Gets the shortest decimal digits of a non-negative number
+// The value is 0.d1d2d3... * 10^point. Zero has no digits.
+static int decimal_digits(double value, char *digits, int *point)
+{
+    *point = 1;
+    if (value == 0.0) return 0;
     
-    // Print
-    syscall_str4(1, 1, (char *)number, length);
+    int exp10;
+    int count = dtoa_shortest(value, digits, &exp10);
+    *point = count + exp10;
+    return count;
 }
 
-void printf(const char *line, int64_t arg1, int64_t arg2, int64_t arg3, int64_t arg4, int64_t arg5)
+// Writes digits (0.d1d2d3... * 10^point) with prec decimals
+// Places past the last digit are zeros; the digits must already be rounded.
+static int write_fixed(char *buf, const char *digits, int count, int point, int prec)
 {
-    int size = strlen(line);
-    char buffer[size];
-    int index = 0;
-    int argIndex = 0;
+    int len = 0;
+    if (point <= 0) buf[len++] = '0';
+    for (int i = 0; i<point; i++) buf[len++] = i < count ? digits[i] : '0';
     
-    for (int i = 0; i<size; i++) {
-        if (line[i] == '%' && line[i+1] == 'd') {
-            syscall_str4(1, 1, (char *)buffer, index);
-            for (int j = 0; j<index; j++) buffer[j] = 0;
-            index = 0;
-            
-            switch (argIndex) {
-                case 0: printInt(arg1); break;
-                case 1: printInt(arg2); break;
-                case 2: printInt(arg3); break;
-                case 3: printInt(arg4); break;
-                case 4: printInt(arg5); break;
-                default: {}
+    if (prec > 0) buf[len++] = '.';
+    for (int i = point; i<point + prec; i++) buf[len++] = (i >= 0 && i < count) ? digits[i] : '0';
+    return len;
+}
+
+// Writes digits (0.d1d2d3... * 10^point) as d.ddde+XX, with prec decimals
+static int write_exp(char *buf, const char *digits, int count, int point, int prec, char e)
+{
+    int exp = count > 0 ? point - 1 : 0;
+    
+    int len = 0;
+    buf[len++] = count > 0 ? digits[0] : '0';
+    if (prec > 0) buf[len++] = '.';
+    for (int i = 1; i<=prec; i++) buf[len++] = i < count ? digits[i] : '0';
+    
+    buf[len++] = e;
+    buf[len++] = exp < 0 ? '-' : '+';
+    if (exp < 0) exp = -exp;
+    if (exp < 10) buf[len++] = '0';
+    len += format_u64(buf + len, exp);
+    return len;
+}
+
+// Writes a non-negative number with a fixed number of decimals
+// The digits are the exact value rounded at the last decimal, not the shortest digits
+// rounded again, so ties and near-ties come out as they do in C.
+static int format_fixed(char *buf, double value, int prec)
+{
+    char digits[FMT_BUFFER_SIZE];
+    int point;
+    int count = dtoa_fixed(value, prec, digits, &point);
+    return write_fixed(buf, digits, count, point, prec);
+}
+
+// Writes a non-negative number as d.ddde+XX
+static int format_exp(char *buf, double value, int prec, char e)
+{
+    char digits[MAX_PRECISION + 2];
+    int point = 1;
+    int count = dtoa_precision(value, prec + 1, digits, &point);
+    return write_exp(buf, digits, count, point, prec, e);
+}
+
+// Drops trailing zeros after the point (and the point itself if nothing is left)
+static int trim_zeros(char *buf, int len)
+{
+    int point = -1;
+    int end = len;
+    for (int i = 0; i<len; i++) {
+        if (buf[i] == '.') point = i;
+        if (buf[i] == 'e' || buf[i] == 'E') {
+            end = i;
+            break;
+        }
+    }
+    if (point < 0) return len;
+    
+    int last = end;
+    while (last > point + 1 && buf[last - 1] == '0') --last;
+    if (last == point + 1) --last;
+    
+    for (int i = end; i<len; i++) buf[last + i - end] = buf[i];
+    return last + (len - end);
+}
+
+// Writes a non-negative number like %g: fixed or with an exponent, whichever suits it
+// With no precision, the shortest digits that read back as the number are used, and
+// at least 6 are shown. With one, the number is rounded to that many digits.
+static int format_general(char *buf, double value, int prec, char e, int alt)
+{
+    char digits[MAX_PRECISION + 2];
+    int point = 1;
+    int count;
+    
+    if (prec < 0) {
+        count = decimal_digits(value, digits, &point);
+        prec = count > 6 ? count : 6;
+    } else {
+        if (prec == 0) prec = 1;
+        count = dtoa_precision(value, prec, digits, &point);
+    }
+    int exp = count > 0 ? point - 1 : 0;
+    
+    int len;
+    if (exp < -4 || exp >= prec) len = write_exp(buf, digits, count, point, prec - 1, e);
+    else len = write_fixed(buf, digits, count, point, prec - 1 - exp);
+    
+    if (!alt) len = trim_zeros(buf, len);
+    return len;
+}
+
+static void format_float(Sink *sink, FormatSpec *spec, char conv, double value)
+{
+    char body[FMT_BUFFER_SIZE];
+    int bodyLen = 0;
+    
+    char prefix[1];
+    int prefixLen = 0;
+    int negative = value < 0.0 || (value == 0.0 && 1.0 / value < 0.0);
+    if (negative) value = -value;
+    
+    if (negative) prefix[prefixLen++] = '-';
+    else if (spec->plus) prefix[prefixLen++] = '+';
+    else if (spec->space) prefix[prefixLen++] = ' ';
+    
+    int upper = conv == 'E' || conv == 'G' || conv == 'F';
+    if (value != value || value > 1.7976931348623157e308) {
+        const char *text = value != value ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+        spec->zero = 0;
+        sink_field(sink, spec, prefix, prefixLen, text, 3);
+        return;
+    }
+    
+    int prec = spec->precision;
+    if (prec > MAX_PRECISION) prec = MAX_PRECISION;
+    
+    if (conv == 'f' || conv == 'F') {
+        bodyLen = format_fixed(body, value, prec < 0 ? 6 : prec);
+        if (spec->alt && prec == 0) body[bodyLen++] = '.';
+    } else if (conv == 'e' || conv == 'E') {
+        bodyLen = format_exp(body, value, prec < 0 ? 6 : prec, upper ? 'E' : 'e');
+    } else {
+        bodyLen = format_general(body, value, prec, upper ? 'E' : 'e', spec->alt);
+    }
+    
+    sink_field(sink, spec, prefix, prefixLen, body, bodyLen);
+}
+
+static void sink_format(Sink *sink, const char *format, va_list args)
+{
+    const char *segment = format;
+    
+    while (*format) {
+        if (*format != '%') {
+            ++format;
+            continue;
+        }
+        
+        sink_write(sink, segment, format - segment);
+        ++format;
+        
+        FormatSpec spec = { 0, 0, 0, 0, 0, 0, -1 };
+        for (;;) {
+            if (*format == '-') spec.left = 1;
+            else if (*format == '0') spec.zero = 1;
+            else if (*format == '+') spec.plus = 1;
+            else if (*format == ' ') spec.space = 1;
+            else if (*format == '#') spec.alt = 1;
+            else break;
+            ++format;
+        }
+        
+        if (*format == '*') {
+            spec.width = va_arg(args, int64_t);
+            if (spec.width < 0) {
+                spec.left = 1;
+                spec.width = -spec.width;
             }
+            ++format;
+        } else {
+            while (*format >= '0' && *format <= '9') spec.width = spec.width * 10 + (*format++ - '0');
+        }
+        
+        if (*format == '.') {
+            ++format;
+            spec.precision = 0;
+            if (*format == '*') {
+                spec.precision = va_arg(args, int64_t);
+                ++format;
+            } else {
+                while (*format >= '0' && *format <= '9') spec.precision = spec.precision * 10 + (*format++ - '0');
+            }
+        }
+        
+        // Every integer argument arrives widened to 64 bits. That keeps %d right at
+        // any size, but the unsigned conversions only look at the bits the length
+        // modifier asks for: 32 with none, as in C.
+        int bits = 32;
+        if (*format == 'h') {
+            bits = 16;
+            if (*++format == 'h') {
+                bits = 8;
+                ++format;
+            }
+        }
+        while (*format == 'l' || *format == 'z' || *format == 'j' || *format == 't') {
+            bits = 64;
+            ++format;
+        }
+        if (spec.left) spec.zero = 0;
+        
+        char conv = *format;
+        if (conv) ++format;
+        
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                int64_t value = va_arg(args, int64_t);
+                uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+                format_integer(sink, &spec, conv, magnitude, value < 0);
+            } break;
             
-            ++i;
-            ++argIndex;
-        } else if (line[i] == '%' && line[i+1] == 'x') {
-            syscall_str4(1, 1, (char *)buffer, index);
-            for (int j = 0; j<index; j++) buffer[j] = 0;
-            index = 0;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                uint64_t value = va_arg(args, uint64_t);
+                if (bits < 64) value &= ((uint64_t)1 << bits) - 1;
+                format_integer(sink, &spec, conv, value, 0);
+            } break;
             
-            switch (argIndex) {
-                case 0: printHex(arg1); break;
-                case 1: printHex(arg2); break;
-                case 2: printHex(arg3); break;
-                case 3: printHex(arg4); break;
-                case 4: printHex(arg5); break;
-                default: {}
-            }
+            case 'p': format_integer(sink, &spec, conv, (uint64_t)va_arg(args, void *), 0); break;
             
-            ++i;
-            ++argIndex;
-        } else if (line[i] == '%' && line[i+1] == 'c') {
-            syscall_str4(1, 1, (char *)buffer, index);
-            for (int j = 0; j<index; j++) buffer[j] = 0;
-            index = 0;
+            case 'c': {
+                char c = (char)va_arg(args, int64_t);
+                sink_field(sink, &spec, "", 0, &c, 1);
+            } break;
             
-            char buf[1];
+            case 's': {
+                const char *str = va_arg(args, const char *);
+                if (!str) str = "(null)";
+                
+                int64_t len = 0;
+                while (str[len] && (spec.precision < 0 || len < spec.precision)) ++len;
+                spec.zero = 0;
+                sink_field(sink, &spec, "", 0, str, len);
+            } break;
             
-            switch (argIndex) {
-                case 0: buf[0] = (char)arg1; break;
-                case 1: buf[0] = (char)arg2; break;
-                case 2: buf[0] = (char)arg3; break;
-                case 3: buf[0] = (char)arg4; break;
-                case 4: buf[0] = (char)arg5; break;
-                default: {}
-            }
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G': format_float(sink, &spec, conv, va_arg(args, double)); break;
             
-            syscall_str4(1, 1, (char *)buf, 1);
-            ++i;
-            ++argIndex;
-        } else if (line[i] == '\\' && line[i+1] == 'n') {
-            buffer[index] = '\n';
-            ++index;
-        } else {
-            buffer[index] = line[i];
-            ++index;
+            case '%': sink_write(sink, "%", 1); break;
+            
+            // Anything we don't know is written out as it was
+            default: {
+                sink_write(sink, "%", 1);
+                if (conv) sink_write(sink, &conv, 1);
+            }
         }
+        
+        segment = format;
     }
     
-    syscall_str4(1, 1, (char *)buffer, index);
+    sink_write(sink, segment, format - segment);
+}
+
+void printf(const char *format, ...)
+{
+    Sink sink = { 0, 0, 0, 1 };
+    
+    va_list args;
+    va_start(args, format);
+    sink_format(&sink, format, args);
+    va_end(args);
+}
+
+// Formats into buf, which holds size bytes including the null
+// Returns the length the whole result would have had.
+int64_t snprintf(char *buf, int64_t size, const char *format, ...)
+{
+    Sink sink = { buf, size, 0, -1 };
+    
+    va_list args;
+    va_start(args, format);
+    sink_format(&sink, format, args);
+    va_end(args);
+    
+    if (size > 0) buf[sink.len < size ? sink.len : size - 1] = '\0';
+    return sink.len;
+}
+
+// Writes a number like %f, for printf calls the compiler breaks up ahead of time
+void format_double(double num)
+{
+    FormatSpec spec = { 0, 0, 0, 0, 0, 0, -1 };
+    Sink sink = { 0, 0, 0, 1 };
+    format_float(&sink, &spec, 'f', num);
 }
 
 void printDouble(double num)
 {
-   char flt_num[64];
-   int i = 0;
-   
-   if (num < 0.0) {
-       flt_num[i++] = '-';
-       num *= -1;
-   }
-   
-   int whole = num;     // Gets us the whole number part
-   num -= whole;        // Gets us the decimal part
-   
-   // Print the whole number part
-   if (whole == 0) {
-       flt_num[i++] = '0';
-   } else {
-       // Count the number of digits
-       int digits = 0;
-       int whole2 = whole;
-       while (whole2 != 0) {
-           whole2 /= 10;
-           ++digits;
-       }
-       
-       char buf[digits];
-       int j = 0;
-       while (whole != 0) {
-           int digit = whole % 10;
-           whole /= 10;
-           buf[j++] = digit + '0';
-       }
-       
-       for (int ii = digits - 1; ii>=0; ii--) flt_num[i++] = buf[ii];
-   }
-   
-   flt_num[i++] = '.';
-   
-   // Print the decimal part
-   for (int j = 0; j<precision; j++) {
-       num *= 10.0;
-       int digit = num;
-       flt_num[i++] = digit + '0';
-       num -= digit;
-   }
-   
-   flt_num[i++] = '\n';
-   //flt_num[i++] = '\0';
-   
-   syscall_str4(1, 1, (char *)flt_num, i);
+    FormatSpec spec = { 0, 0, 0, 0, 0, 0, precision };
+    Sink sink = { 0, 0, 0, 1 };
+    
+    format_float(&sink, &spec, 'f', num);
+    sink_write(&sink, "\n", 1);
+}
+
+// Converts a number to a string with the shortest digits that read back the same
+// Large and small numbers get an exponent (1e+21, 1e-07).
+char *dtostr(double num)
+{
+    char buf[32];
+    int len = 0;
+    
+    if (num != num) {
+        len = 3;
+        buf[0] = 'n'; buf[1] = 'a'; buf[2] = 'n';
+    } else {
+        if (num < 0.0) {
+            buf[len++] = '-';
+            num = -num;
+        }
+        
+        if (num > 1.7976931348623157e308) {
+            buf[len++] = 'i'; buf[len++] = 'n'; buf[len++] = 'f';
+        } else {
+            char digits[20];
+            int point;
+            int count = decimal_digits(num, digits, &point);
+            
+            if (count == 0) buf[len++] = '0';
+            else if (point > -6 && point <= 21) len += write_fixed(buf + len, digits, count, point, count > point ? count - point : 0);
+            else len += write_exp(buf + len, digits, count, point, count - 1, 'e');
+        }
+    }
+    
+    char *str = str_new(len, 0);
+    for (int i = 0; i<len; i++) str[i] = buf[i];
+    return str;
 }
 
 void printFloat(float num)
@@ -19,6 +19,7 @@ print("[TEST] " + basename)
 output = []
 in_output = False
 ret = 0
+args = []
 
 with open(test_file) as reader:
 	for ln in reader:
@@ -30,10 +31,12 @@ with open(test_file) as reader:
 			in_output = False
 		elif ln.startswith("#RET"):
 			ret = int(ln.split()[1])
+		elif ln.startswith("#ARGS"):
+			args = ln.split()[1:]
 		elif in_output:
 			output.append(ln[1:])
 			
-result = subprocess.run([bin_file], stdout=subprocess.PIPE)
+result = subprocess.run([bin_file] + args, stdout=subprocess.PIPE)
 cmd_output = result.stdout.decode('utf-8').split('\n')
 cmd_output.remove('')
 rc = result.returncode
@@ -51,19 +54,17 @@ if is_output:
 			break
 			
 is_ret = True
-if test_type != "error":
-	if rc != ret:
-		is_ret = False
+if rc != ret:
+	is_ret = False
 
 # Print results if wrong
 if (not is_ret) or (not is_output):
 	print("Expected Output: " + str(output))
 	print("CMD Output: " + str(cmd_output))
 	print("")
-	if test_type != "error":
-		print("Expected Return: " + str(ret))
-		print("Actual Return: " + str(rc))
-		print("")
+	print("Expected Return: " + str(ret))
+	print("Actual Return: " + str(rc))
+	print("")
 	print("Fail")
 	exit(1)
 	
@@ -14,7 +14,7 @@ function run_test() {
             fi
             
             echo "#!/bin/bash" >> ERROR_TEST.sh
-            echo "$OCC $entry --use-c" >> ERROR_TEST.sh
+            echo "$OCC $entry 2>&1" >> ERROR_TEST.sh
             chmod 777 ERROR_TEST.sh
             ./test.py $entry  ./ERROR_TEST.sh "error"
             
@@ -64,6 +64,8 @@ run_test 'test/struct/*.ok' 'sys' $flags
 run_test 'test/float/*.ok' 'sys' $flags
 run_test 'test/str/*.ok' 'sys' $flags
 run_test 'test/class/*.ok' 'sys' $flags
+run_test 'test/bounds/*.ok' 'sys' "$flags --bounds-check"
+run_test 'test/errors/*.ok' 'sys' 'error'
 
 echo ""
 echo "$test_count tests passed successfully."